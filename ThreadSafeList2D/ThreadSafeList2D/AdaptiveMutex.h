@@ -0,0 +1,223 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+/// Tells the CPU that the caller is spinning (pause instruction on x86).
+inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+/// Counters of an AdaptiveMutex, see AdaptiveMutex::stats().
+struct LockStats {
+  uint64_t acquisitions;  /// successful lock() and try_lock() calls
+  uint64_t contended;     /// lock() calls that found the lock taken
+  uint64_t parked;        /// lock() calls that had to sleep in the kernel
+
+  /// Share of acquisitions that found the lock taken.
+  double contention_rate() const noexcept {
+    return acquisitions ? static_cast<double>(contended) / acquisitions : 0;
+  }
+};
+
+/**
+ * \class AdaptiveMutex
+ *
+ *
+ * \brief Spin-then-park mutex for short critical sections.
+ *
+ * An uncontended lock() is a single compare-and-swap. Under contention the
+ * caller first spins up to the spin budget, backing off exponentially with
+ * the CPU pause instruction between attempts, and only then sleeps on the
+ * lock word (futex on Linux, WaitOnAddress on Windows, std::atomic::wait or
+ * yielding elsewhere). unlock() makes a system call only if somebody sleeps.
+ *
+ * Meets the Lockable requirements, so it works with std::lock_guard and
+ * std::unique_lock. Contention counters are updated by the lock owner and
+ * can be read at any time.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+class AdaptiveMutex {
+ public:
+  /// Pause instructions spent spinning before parking, by default.
+  static constexpr uint32_t kDefaultSpinBudget = 4096;
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "the lock word must be a plain 32-bit integer");
+
+  explicit AdaptiveMutex(uint32_t spin_budget = kDefaultSpinBudget) noexcept
+      : state_(kUnlocked),
+        spin_budget_(spin_budget),
+        acquisitions_(0),
+        contended_(0),
+        parked_(0) {}
+
+  AdaptiveMutex(const AdaptiveMutex& rhs) = delete;
+  AdaptiveMutex& operator=(const AdaptiveMutex& rhs) = delete;
+
+  /// Acquires the lock, spinning and then sleeping while it is taken.
+  void lock() noexcept {
+    uint32_t expected = kUnlocked;
+    if (state_.compare_exchange_strong(expected, kLocked,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+      count(false, false);
+      return;
+    }
+    if (spin()) {
+      count(true, false);
+      return;
+    }
+    // Leaves kWaiters behind, so the eventual unlock() wakes the next one.
+    while (state_.exchange(kWaiters, std::memory_order_acquire) !=
+           kUnlocked) {
+      park();
+    }
+    count(true, true);
+  }
+
+  /// Acquires the lock only if it is free right now.
+  bool try_lock() noexcept {
+    uint32_t expected = kUnlocked;
+    if (!state_.compare_exchange_strong(expected, kLocked,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+      return false;
+    }
+    count(false, false);
+    return true;
+  }
+
+  /// Releases the lock and wakes one sleeping thread, if any.
+  void unlock() noexcept {
+    if (state_.exchange(kUnlocked, std::memory_order_release) == kWaiters) {
+      wake();
+    }
+  }
+
+  /// Sets the number of pause instructions spent spinning before parking.
+  void set_spin_budget(uint32_t spin_budget) noexcept {
+    spin_budget_.store(spin_budget, std::memory_order_relaxed);
+  }
+
+  /// Current spin budget.
+  uint32_t spin_budget() const noexcept {
+    return spin_budget_.load(std::memory_order_relaxed);
+  }
+
+  /// Snapshot of the contention counters.
+  LockStats stats() const noexcept {
+    return LockStats{acquisitions_.load(std::memory_order_relaxed),
+                     contended_.load(std::memory_order_relaxed),
+                     parked_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  static constexpr uint32_t kUnlocked = 0;
+  static constexpr uint32_t kLocked = 1;
+  static constexpr uint32_t kWaiters = 2;  /// locked, somebody may sleep
+  /// Longest run of pause instructions between two attempts.
+  static constexpr uint32_t kMaxBackoff = 64;
+
+  std::atomic<uint32_t> state_;  /// the word the kernel sleeps on
+  std::atomic<uint32_t> spin_budget_;
+  // Written only by the owner, so plain load/store is enough.
+  std::atomic<uint64_t> acquisitions_;
+  std::atomic<uint64_t> contended_;
+  std::atomic<uint64_t> parked_;
+
+  void count(bool contended, bool parked) noexcept {
+    increment(acquisitions_);
+    if (contended) {
+      increment(contended_);
+    }
+    if (parked) {
+      increment(parked_);
+    }
+  }
+
+  static void increment(std::atomic<uint64_t>& counter) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  /// Spins with exponential backoff, returns true if the lock was taken.
+  bool spin() noexcept {
+    uint32_t budget = spin_budget_.load(std::memory_order_relaxed);
+    uint32_t backoff = 1;
+    for (uint32_t spent = 0; spent < budget; spent += backoff) {
+      for (uint32_t i = 0; i < backoff; ++i) {
+        cpu_relax();
+      }
+      if (backoff < kMaxBackoff) {
+        backoff <<= 1;
+      }
+      uint32_t state = state_.load(std::memory_order_relaxed);
+      if (state == kWaiters) {
+        return false;  // others already sleep, do not overtake them
+      }
+      uint32_t expected = kUnlocked;
+      if (state == kUnlocked &&
+          state_.compare_exchange_weak(expected, kLocked,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Sleeps while the lock word still says kWaiters.
+  void park() noexcept {
+#if defined(_WIN32)
+    uint32_t waiters = kWaiters;
+    WaitOnAddress(&state_, &waiters, sizeof(waiters), INFINITE);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_),
+            FUTEX_WAIT_PRIVATE, kWaiters, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+    state_.wait(kWaiters, std::memory_order_relaxed);
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  void wake() noexcept {
+#if defined(_WIN32)
+    WakeByAddressSingle(&state_);
+#elif defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+    state_.notify_one();
+#endif
+  }
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "AdaptiveMutex.h"
+#include "Numa.h"
+
+/**
+ * \class CohortLock
+ *
+ *
+ * \brief NUMA-aware lock that hands off within a socket before crossing it.
+ *
+ * A global lock is combined with one local lock per NUMA node. A thread
+ * first takes the local lock of its node and then the global one, unless a
+ * previous owner from the same node passed the global lock along. On
+ * unlock, if another thread of the same node is waiting, the global lock is
+ * handed to it directly, up to max_handoffs times in a row; then it is
+ * released so that the other nodes are not starved. The data guarded by
+ * the lock thus stays in one socket's caches for whole batches of critical
+ * sections.
+ *
+ * Both levels are AdaptiveMutex, so waiters spin briefly and then sleep;
+ * the global lock may be released by a different thread than the one that
+ * took it. Meets the Lockable requirements, so it can be used as the lock
+ * of ThreadSafeList2D.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+class CohortLock {
+  /// Local lock of one NUMA node with the cohort state it protects.
+  struct alignas(64) Cohort {
+    AdaptiveMutex lock;
+    std::atomic<uint32_t> waiting{0};  /// threads inside lock()
+    bool global_owned = false;  /// the global lock was passed along
+    uint32_t handoffs = 0;      /// consecutive local handoffs
+  };
+
+ public:
+  /// Consecutive handoffs within a node before the global lock is released.
+  static constexpr uint32_t kDefaultMaxHandoffs = 64;
+
+  explicit CohortLock(uint32_t max_handoffs = kDefaultMaxHandoffs)
+      : count_(numa_node_count()),
+        cohorts_(new Cohort[count_]),
+        max_handoffs_(max_handoffs),
+        owner_(0) {}
+
+  CohortLock(const CohortLock& rhs) = delete;
+  CohortLock& operator=(const CohortLock& rhs) = delete;
+
+  /// Acquires the lock.
+  void lock() noexcept {
+    size_t node = current_numa_node() % count_;
+    Cohort& cohort = cohorts_[node];
+    cohort.waiting.fetch_add(1, std::memory_order_relaxed);
+    cohort.lock.lock();
+    cohort.waiting.fetch_sub(1, std::memory_order_relaxed);
+    if (!cohort.global_owned) {
+      global_.lock();
+    }
+    owner_ = node;
+  }
+
+  /// Acquires the lock only if it is free right now.
+  bool try_lock() noexcept {
+    size_t node = current_numa_node() % count_;
+    Cohort& cohort = cohorts_[node];
+    if (!cohort.lock.try_lock()) {
+      return false;
+    }
+    if (!cohort.global_owned && !global_.try_lock()) {
+      cohort.lock.unlock();
+      return false;
+    }
+    owner_ = node;
+    return true;
+  }
+
+  /// Releases the lock, preferring a waiter from the owner's node.
+  void unlock() noexcept {
+    Cohort& cohort = cohorts_[owner_];
+    if (cohort.handoffs < max_handoffs_ &&
+        cohort.waiting.load(std::memory_order_relaxed) > 0) {
+      ++cohort.handoffs;
+      cohort.global_owned = true;
+    } else {
+      cohort.handoffs = 0;
+      cohort.global_owned = false;
+      global_.unlock();
+    }
+    cohort.lock.unlock();
+  }
+
+ private:
+  AdaptiveMutex global_;
+  const size_t count_;
+  std::unique_ptr<Cohort[]> cohorts_;  /// one per NUMA node
+  const uint32_t max_handoffs_;
+  size_t owner_;  /// node of the current owner, written under the lock
+};
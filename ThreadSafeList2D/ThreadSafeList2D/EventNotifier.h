@@ -0,0 +1,151 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/**
+ * \struct NotifierError
+ *
+ *
+ * \brief Simple struct for NotifierError exception
+ *
+ * The exception returns string "Cannot create notification descriptor". It
+ * is thrown when the operating system refuses to create the eventfd or pipe
+ * behind an EventNotifier.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+struct NotifierError : public std::exception {
+  /// main method that returns message
+  const char* what() const throw() {
+    return "Cannot create notification descriptor";
+  }
+};
+
+/**
+ * \class EventNotifier
+ *
+ *
+ * \brief File descriptor that becomes readable when signalled.
+ *
+ * Backed by an eventfd on Linux and by a pipe elsewhere, so it can be
+ * registered with epoll, poll or select. Signals coalesce: the descriptor
+ * stays readable until acknowledge() is called, however many times
+ * signal() ran in between, and at most one system call is made per
+ * signal/acknowledge pair.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+class EventNotifier {
+ public:
+  /// Creates the descriptor, throws NotifierError on failure.
+  EventNotifier() : pending_(false) {
+#ifdef __linux__
+    read_fd_ = write_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (read_fd_ < 0) {
+      throw NotifierError();
+    }
+#else
+    int fds[2];
+#ifdef _WIN32
+    int status = _pipe(fds, 64, _O_BINARY);
+#else
+    int status = pipe(fds);
+#endif
+    if (status != 0) {
+      throw NotifierError();
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+#endif
+  }
+
+  EventNotifier(const EventNotifier& rhs) = delete;
+  EventNotifier& operator=(const EventNotifier& rhs) = delete;
+
+  ~EventNotifier() {
+#ifdef _WIN32
+    _close(read_fd_);
+    _close(write_fd_);
+#else
+    close(read_fd_);
+    if (write_fd_ != read_fd_) {
+      close(write_fd_);
+    }
+#endif
+  }
+
+  /// Descriptor to wait on for readability.
+  int fd() const noexcept { return read_fd_; }
+
+  /** \brief Makes the descriptor readable.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void signal() noexcept {
+    if (pending_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+    uint64_t one = 1;
+#ifdef _WIN32
+    _write(write_fd_, &one, 1);
+#elif defined(__linux__)
+    ssize_t written = write(write_fd_, &one, sizeof(one));
+    (void)written;
+#else
+    ssize_t written = write(write_fd_, &one, 1);
+    (void)written;
+#endif
+  }
+
+  /** \brief Makes the descriptor non-readable again.
+   *
+   * Call it before consuming the events the signal was for, so that events
+   * arriving meanwhile signal again.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void acknowledge() noexcept {
+    if (!pending_.exchange(false, std::memory_order_acq_rel)) {
+      return;
+    }
+    // The matching write may still be in flight; the read waits for it.
+    uint64_t value;
+#ifdef _WIN32
+    _read(read_fd_, &value, 1);
+#elif defined(__linux__)
+    ssize_t got = read(read_fd_, &value, sizeof(value));
+    (void)got;
+#else
+    ssize_t got = read(read_fd_, &value, 1);
+    (void)got;
+#endif
+  }
+
+ private:
+  int read_fd_;
+  int write_fd_;                /// same as read_fd_ for an eventfd
+  std::atomic<bool> pending_;   /// a signal is written and not acknowledged
+};
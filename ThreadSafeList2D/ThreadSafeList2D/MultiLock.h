@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+
+/**
+ * \class MultiLock
+ *
+ *
+ * \brief Holds several locks at once without risking lock-order deadlocks.
+ *
+ * \tparam Lock Lockable type of the locks.
+ * \tparam N Number of locks passed to the constructor.
+ *
+ * The locks are always acquired in one global order, ascending address as
+ * given by std::less, so two threads locking the same set of objects in
+ * different argument order cannot wait for each other. The same lock may
+ * be passed more than once; it is taken only once. Locks are released in
+ * reverse order by unlock() or the destructor.
+ *
+ * ThreadSafeList2D uses it for every operation that spans several lists.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class Lock, size_t N>
+class MultiLock {
+ public:
+  /// Acquires all locks in address order. If one lock() throws, the locks
+  /// already taken are released and the exception propagates.
+  explicit MultiLock(const std::array<Lock*, N>& locks)
+      : locks_(locks), count_(0) {
+    std::sort(locks_.begin(), locks_.end(), std::less<Lock*>());
+    const size_t unique = static_cast<size_t>(
+        std::unique(locks_.begin(), locks_.end()) - locks_.begin());
+    try {
+      for (; count_ < unique; ++count_) {
+        locks_[count_]->lock();
+      }
+    } catch (...) {
+      unlock();
+      throw;
+    }
+  }
+
+  MultiLock(const MultiLock& rhs) = delete;
+  MultiLock& operator=(const MultiLock& rhs) = delete;
+
+  /// Releases the locks unless unlock() did already.
+  ~MultiLock() { unlock(); }
+
+  /// Releases the locks still held, in reverse order of acquisition.
+  void unlock() noexcept {
+    while (count_ > 0) {
+      locks_[--count_]->unlock();
+    }
+  }
+
+ private:
+  std::array<Lock*, N> locks_;  /// sorted, the first count_ ones are held
+  size_t count_;
+};
@@ -0,0 +1,345 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "Numa.h"
+
+/**
+ * \class NodePool
+ *
+ *
+ * \brief Process-wide slab allocator for fixed-size list nodes.
+ *
+ * \tparam Node Node type whose storage is managed by the pool.
+ *
+ * Storage is carved from slabs of contiguous slots and recycled through a
+ * free list. Every thread keeps a small private cache, so the pool mutex is
+ * taken once per batch of allocations instead of once per node. Pooled slabs
+ * are never handed back to the system, which makes a slot allocated by one
+ * list safe to release from any other list of the same node type.
+ *
+ * Every slot starts with a tag naming its owner, one pointer in front of
+ * the node, so a released slot is sorted out on its own without a lookup.
+ * Contiguous slabs (see allocate_contiguous()) are sized by their caller
+ * and own their slots: a released slot is counted against its slab instead
+ * of entering a free list, and the slab is deleted once all of its slots
+ * are back. They hold at most kSlab slots, so a few surviving nodes pin
+ * little memory. Pooled slots keep the cache path whatever slabs exist.
+ *
+ * Free slots are kept in one arena per NUMA node. A thread refills its cache
+ * from the arena of the node it runs on, and fresh slabs are first written
+ * by that thread, so their pages land in local memory. Every slab belongs to
+ * the arena it was allocated for, and its slots always go back there, also
+ * when another node's thread releases them. Slots of another arena are
+ * collected per thread and handed back kBatch at a time, so they cost one
+ * arena lock per batch.
+ *
+ * The pool only deals with raw storage: construction and destruction of the
+ * node itself is done by the caller.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class Node>
+class NodePool {
+  /// Owner of a slot: the arena of a pooled slot or its contiguous slab.
+  struct Owner {
+    size_t arena = 0;  /// NUMA node whose arena owns the slot
+    size_t size = 0;   /// slots of a contiguous slab, 0 for a pooled slot
+    std::atomic<size_t> returned{0};  /// slots of the slab released so far
+    void* slab = nullptr;             /// storage of a contiguous slab
+  };
+
+  /// Link of a free slot, written over the node storage. The node's first
+  /// member is overwritten, so a chain of nodes already is a free list.
+  struct Free {
+    Free* next;
+  };
+
+  /// Storage for one node, tagged with its owner.
+  struct Slot {
+    Owner* owner;
+    alignas(Node) unsigned char storage[sizeof(Node)];
+  };
+
+  /// Per-thread stash of free slots, flushed back to the pool on thread exit.
+  struct Cache {
+    Free* head = nullptr;
+    size_t count = 0;
+    size_t arena = 0;  /// NUMA node the thread refilled from last time
+    Free* returned = nullptr;  /// released slots of other arenas
+    size_t returned_count = 0;
+    ~Cache() {
+      NodePool& pool = NodePool::instance();
+      pool.release(head);
+      pool.release(returned);
+    }
+  };
+
+  /// Free slots of one NUMA node.
+  struct alignas(64) Arena {
+    Free* free = nullptr;
+    std::mutex mutex;
+  };
+
+ public:
+  /// Number of slots moved between a thread cache and the pool at once.
+  static constexpr size_t kBatch = 64;
+  /// Largest number of slots in a contiguous slab.
+  static constexpr size_t kSlab = 4096;
+
+  /// Returns the pool shared by all lists of this node type.
+  static NodePool& instance() {
+    // Intentionally leaked: thread caches may flush after static destruction.
+    static NodePool* pool = new NodePool();
+    return *pool;
+  }
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  /** \brief Returns uninitialized storage for a single node.
+   *
+   * \warning throws std::bad_alloc if a new slab cannot be allocated.
+   */
+  void* allocate() {
+    Cache& cache = local_cache();
+    if (!cache.head) {
+      refill(cache);
+    }
+    Free* slot = cache.head;
+    cache.head = slot->next;
+    --cache.count;
+    return slot;
+  }
+
+  /** \brief Returns storage of a destroyed node to the pool.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void deallocate(void* ptr) noexcept {
+    Owner* owner = owner_of(ptr);
+    if (owner->size) {
+      release_contiguous(owner);
+      return;
+    }
+    Cache& cache = local_cache();
+    Free* slot = static_cast<Free*>(ptr);
+    if (owner->arena != cache.arena) {
+      slot->next = cache.returned;
+      cache.returned = slot;
+      if (++cache.returned_count >= kBatch) {
+        Free* returned = cache.returned;
+        cache.returned = nullptr;
+        cache.returned_count = 0;
+        release(returned);
+      }
+      return;
+    }
+    slot->next = cache.head;
+    cache.head = slot;
+    if (++cache.count > 2 * kBatch) {
+      flush(cache, kBatch);
+    }
+  }
+
+  /** \brief Returns a whole chain of destroyed nodes to the pool at once.
+   * \param first first node of the chain
+   * \param last last node of the chain, its link must be null
+   *
+   * Only for node types whose first member is the pointer to the next node:
+   * such a chain already is a free list, so with a single arena and no
+   * contiguous slab alive it is handed back in constant time, however long
+   * it is. Otherwise the chain is walked once to return every slot to its
+   * owner.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void deallocate_chain(void* first, void* last) noexcept {
+    if (arena_count_ > 1 || has_contiguous()) {
+      static_cast<Free*>(last)->next = nullptr;
+      release(static_cast<Free*>(first));
+      return;
+    }
+    give_back(static_cast<Free*>(first), static_cast<Free*>(last), 0);
+  }
+
+  /** \brief Returns storage for count nodes laid out back to back.
+   * \param count number of slots, from 1 to kSlab
+   *
+   * The slots come from a dedicated slab; slot(result, i) is the storage of
+   * the i-th node. Each slot is later released with deallocate() or
+   * deallocate_chain() on its own; the slab goes back to the system together
+   * with its last slot.
+   *
+   * \warning throws std::bad_alloc if the slab cannot be allocated.
+   */
+  void* allocate_contiguous(size_t count) {
+    std::unique_ptr<Slot[]> slab(new Slot[count]);
+    Owner* owner = new Owner;
+    owner->arena = current_numa_node() % arena_count_;
+    owner->size = count;
+    owner->slab = slab.get();
+    for (size_t i = 0; i < count; ++i) {
+      slab[i].owner = owner;
+    }
+    reserved_.fetch_add(count, std::memory_order_relaxed);
+    contiguous_.fetch_add(1, std::memory_order_relaxed);
+    return slab.release()[0].storage;
+  }
+
+  /// Returns the storage of the i-th slot of a contiguous slab, given the
+  /// storage of its first slot.
+  static void* slot(void* first, size_t i) noexcept {
+    return (slot_of(first) + i)->storage;
+  }
+
+  /// Returns the number of slots held by all slabs, free or not.
+  size_t reserved() const noexcept {
+    return reserved_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  NodePool()
+      : arena_count_(numa_node_count()),
+        arenas_(new Arena[arena_count_]),
+        owners_(new Owner[arena_count_]) {
+    for (size_t i = 0; i < arena_count_; ++i) {
+      owners_[i].arena = i;
+    }
+  }
+
+  const size_t arena_count_;
+  std::unique_ptr<Arena[]> arenas_;  /// one per NUMA node
+  std::unique_ptr<Owner[]> owners_;  /// tags of the pooled slots, per arena
+  std::atomic<size_t> reserved_{0};    /// slots of all slabs
+  std::atomic<size_t> contiguous_{0};  /// contiguous slabs alive
+
+  static Cache& local_cache() noexcept {
+    static thread_local Cache cache;
+    return cache;
+  }
+
+  static Slot* slot_of(void* storage) noexcept {
+    return reinterpret_cast<Slot*>(static_cast<unsigned char*>(storage) -
+                                   offsetof(Slot, storage));
+  }
+
+  static Owner* owner_of(void* storage) noexcept {
+    return slot_of(storage)->owner;
+  }
+
+  /// Returns true if some contiguous slab still has slots out. A thread
+  /// releasing such a slot got it through the list lock after the slab was
+  /// allocated, so it can never read zero here.
+  bool has_contiguous() const noexcept {
+    return contiguous_.load(std::memory_order_relaxed) != 0;
+  }
+
+  /// Counts a released slot of a contiguous slab and deletes the slab with
+  /// its last slot.
+  void release_contiguous(Owner* owner) noexcept {
+    // acq_rel: the thread that deletes the slab sees every other release.
+    if (owner->returned.fetch_add(1, std::memory_order_acq_rel) + 1 <
+        owner->size) {
+      return;
+    }
+    reserved_.fetch_sub(owner->size, std::memory_order_relaxed);
+    delete[] static_cast<Slot*>(owner->slab);
+    delete owner;
+    contiguous_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /// Moves a batch of free slots (or a fresh slab) into the thread cache.
+  void refill(Cache& cache) {
+    cache.arena = current_numa_node() % arena_count_;
+    Arena& arena = arenas_[cache.arena];
+    std::unique_lock<std::mutex> lock(arena.mutex);
+    if (!arena.free) {
+      lock.unlock();
+      Slot* slab = new Slot[kBatch];
+      reserved_.fetch_add(kBatch, std::memory_order_relaxed);
+      Free* next = nullptr;
+      for (size_t i = kBatch; i-- > 0;) {
+        slab[i].owner = &owners_[cache.arena];
+        Free* slot = reinterpret_cast<Free*>(slab[i].storage);
+        slot->next = next;
+        next = slot;
+      }
+      cache.head = next;
+      cache.count = kBatch;
+      return;
+    }
+    Free* last = arena.free;
+    size_t taken = 1;
+    while (taken < kBatch && last->next) {
+      last = last->next;
+      ++taken;
+    }
+    cache.head = arena.free;
+    arena.free = last->next;
+    last->next = nullptr;
+    cache.count = taken;
+  }
+
+  /// Hands count slots from the front of the thread cache back to the pool.
+  void flush(Cache& cache, size_t count) noexcept {
+    Free* first = cache.head;
+    Free* last = first;
+    for (size_t i = 1; i < count; ++i) {
+      last = last->next;
+    }
+    cache.head = last->next;
+    cache.count -= count;
+    give_back(first, last, cache.arena);
+  }
+
+  /// Links the slots first..last in front of the free list of an arena.
+  void give_back(Free* first, Free* last, size_t arena_index) noexcept {
+    Arena& arena = arenas_[arena_index];
+    std::lock_guard<std::mutex> lock(arena.mutex);
+    last->next = arena.free;
+    arena.free = first;
+  }
+
+  /** \brief Hands a null-terminated chain of slots back to their owners.
+   *
+   * Consecutive slots of the same arena are handed back in one step.
+   */
+  void release(Free* first) noexcept {
+    Free* run = nullptr;  // consecutive slots of one arena
+    Free* run_last = nullptr;
+    size_t run_owner = 0;
+    while (first) {
+      Free* next = first->next;
+      Owner* owner = owner_of(first);
+      if (owner->size) {
+        release_contiguous(owner);
+        first = next;
+        continue;
+      }
+      if (run && owner->arena != run_owner) {
+        give_back(run, run_last, run_owner);
+        run = nullptr;
+      }
+      if (run) {
+        run_last->next = first;
+      } else {
+        run = first;
+        run_owner = owner->arena;
+      }
+      run_last = first;
+      first = next;
+    }
+    if (run) {
+      give_back(run, run_last, run_owner);
+    }
+  }
+};
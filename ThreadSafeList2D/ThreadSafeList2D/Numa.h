@@ -0,0 +1,192 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef TESTING_MODE
+/**
+ * \struct SimulatedNuma
+ *
+ *
+ * \brief NUMA layout pretended on machines with a single node (for testing
+ * purposes only).
+ *
+ * While node_count() is nonzero, numa_node_count() reports it, and a thread
+ * that set its current_node() reports that node. Node pools and locks read
+ * the node count once, when they are created.
+ */
+struct SimulatedNuma {
+  /// Pretended number of nodes, 0 for the real one.
+  static size_t& node_count() noexcept {
+    static size_t count = 0;
+    return count;
+  }
+
+  /// Pretended node of the calling thread, SIZE_MAX for the real one.
+  static size_t& current_node() noexcept {
+    static thread_local size_t node = SIZE_MAX;
+    return node;
+  }
+};
+#endif
+
+/** \brief Returns the number of NUMA nodes of the machine.
+ *
+ * 1 on machines (or platforms) without NUMA information. The value is read
+ * once and cached.
+ *
+ * \note This function is guaranteed not to throw an exception.
+ */
+inline size_t numa_node_count() noexcept {
+#ifdef TESTING_MODE
+  if (SimulatedNuma::node_count() != 0) {
+    return SimulatedNuma::node_count();
+  }
+#endif
+  static const size_t count = [] {
+    size_t result = 1;
+#if defined(_WIN32)
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest)) {
+      result = static_cast<size_t>(highest) + 1;
+    }
+#elif defined(__linux__)
+    // The file lists node ids such as "0" or "0-3"; the last one is the
+    // highest.
+    if (FILE* file = std::fopen("/sys/devices/system/node/possible", "r")) {
+      char text[256] = {};
+      if (std::fgets(text, sizeof(text), file)) {
+        size_t highest = 0;
+        size_t number = 0;
+        for (const char* it = text; *it; ++it) {
+          if (*it >= '0' && *it <= '9') {
+            number = number * 10 + static_cast<size_t>(*it - '0');
+            highest = number;
+          } else {
+            number = 0;
+          }
+        }
+        result = highest + 1;
+      }
+      std::fclose(file);
+    }
+#endif
+    return result;
+  }();
+  return count;
+}
+
+/** \brief Returns the NUMA node the calling thread runs on.
+ *
+ * The answer is cached per thread and refreshed every few hundred calls,
+ * so it is cheap enough for every push but may lag behind a thread that
+ * was just migrated. Always less than numa_node_count().
+ *
+ * \note This function is guaranteed not to throw an exception.
+ */
+inline size_t current_numa_node() noexcept {
+#ifdef TESTING_MODE
+  if (SimulatedNuma::node_count() != 0 &&
+      SimulatedNuma::current_node() != SIZE_MAX) {
+    return SimulatedNuma::current_node() % SimulatedNuma::node_count();
+  }
+#endif
+  constexpr unsigned kRefreshPeriod = 256;
+  static thread_local unsigned calls = 0;
+  static thread_local size_t node = 0;
+  if (calls++ % kRefreshPeriod == 0) {
+#if defined(_WIN32)
+    PROCESSOR_NUMBER processor;
+    USHORT current = 0;
+    GetCurrentProcessorNumberEx(&processor);
+    if (GetNumaProcessorNodeEx(&processor, &current)) {
+      node = current;
+    }
+#elif defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0;
+    unsigned current = 0;
+    if (syscall(SYS_getcpu, &cpu, &current, nullptr) == 0) {
+      node = current;
+    }
+#endif
+    node %= numa_node_count();
+  }
+  return node;
+}
+
+/** \brief Restricts the calling thread to the CPUs of a NUMA node.
+ * \param node NUMA node, less than numa_node_count()
+ *
+ * Used to place threads on given sockets, e.g. for benchmarks. Later calls
+ * of current_numa_node() may report the old node for a few hundred calls.
+ *
+ * \return Outputs false if the platform offers no way to do it or the node
+ * has no CPUs the thread may use.
+ *
+ * \note This function is guaranteed not to throw an exception.
+ */
+inline bool bind_to_numa_node(size_t node) noexcept {
+#if defined(_WIN32)
+  GROUP_AFFINITY affinity = {};
+  return GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) &&
+         affinity.Mask != 0 &&
+         SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+#elif defined(__linux__)
+  // The file lists CPU ids and ranges such as "0-3,8-11".
+  char path[64];
+  std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist",
+                node);
+  FILE* file = std::fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  char text[1024] = {};
+  bool read = std::fgets(text, sizeof(text), file) != nullptr;
+  std::fclose(file);
+  if (!read) {
+    return false;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  size_t first = 0;
+  size_t number = 0;
+  bool digits = false;  // the current entry has a number
+  bool range = false;
+  for (const char* it = text;; ++it) {
+    if (*it >= '0' && *it <= '9') {
+      number = number * 10 + static_cast<size_t>(*it - '0');
+      digits = true;
+    } else if (*it == '-') {
+      first = number;
+      number = 0;
+      range = true;
+    } else {
+      for (size_t cpu = range ? first : number;
+           digits && cpu <= number && cpu < CPU_SETSIZE; ++cpu) {
+        CPU_SET(cpu, &cpus);
+      }
+      if (*it != ',') {
+        break;
+      }
+      number = 0;
+      digits = range = false;
+    }
+  }
+  return CPU_COUNT(&cpus) > 0 &&
+         sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+  (void)node;
+  return false;
+#endif
+}
@@ -0,0 +1,347 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "Numa.h"
+#include "ThreadSafeList2D.h"
+
+/**
+ * \class NumaList2D
+ *
+ *
+ * \brief ThreadSafeList2D split into one sub-list per NUMA node.
+ *
+ * \tparam T Class to store in the linked list.
+ * \tparam Lock Lockable type guarding each sub-list.
+ *
+ * Pushes go to the sub-list of the node the calling thread runs on, so the
+ * node storage (taken from the local NodePool arena) and the sub-list lock
+ * stay on that socket. Pops and reads prefer the local sub-list as well and
+ * steal from the other sub-lists, in round-robin order, only when it is
+ * empty.
+ *
+ * The order of elements is kept per sub-list only: front() and pop_front()
+ * give the first element of some non-empty sub-list. size() and empty() add
+ * up the sub-lists one by one and are therefore approximate while other
+ * threads modify the list. On a machine with a single NUMA node it behaves
+ * as a plain list.
+ *
+ * Only the element-wise part of the ThreadSafeList2D interface is offered:
+ * front/back, size/empty, the pushes (also with a TTL), remove and the
+ * pops, their try_ and _for variants, set_ttl() and expire(). Operations
+ * that need one lock over the whole content (transact(), snapshot(), the
+ * positional methods, compaction, save/load, logs, producers and waiting
+ * pops) have no meaning across sub-lists; use them on a sub_list().
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class T, class Lock = AdaptiveMutex>
+class NumaList2D {
+  using List = ThreadSafeList2D<T, Lock>;
+
+ public:
+  /// Creates one sub-list per NUMA node (or the given number of them).
+  /// With several nodes each sub-list is constructed by a thread bound to
+  /// its node, so its lock, ends and size counter are first touched there.
+  explicit NumaList2D(size_t nodes = numa_node_count()) {
+    lists_.resize(nodes ? nodes : 1);
+    if (lists_.size() == 1) {
+      lists_[0].reset(new List());
+      return;
+    }
+    for (size_t i = 0; i < lists_.size(); ++i) {
+      std::exception_ptr error;
+      std::thread([this, i, &error] {
+        bind_to_numa_node(i);  // best effort, the list works anywhere
+        try {
+          lists_[i].reset(new List());
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }).join();
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  /// Copy constructor is disabled
+  NumaList2D(const NumaList2D& rhs) = delete;
+  /// Copy assignment is disabled
+  NumaList2D& operator=(const NumaList2D& rhs) = delete;
+
+  /** \brief Method returns the value of the first element.
+   *
+   * \return Outputs the first value of the local sub-list or, if it is
+   * empty, of the nearest non-empty one.
+   *
+   * \warning throws AcceessViolation exception if every sub-list is empty.
+   */
+  T front() {
+    return visit([](List& list) { return list.front_if_any(); });
+  }
+
+  /// Same as front() but returns the last value of the sub-list.
+  T back() {
+    return visit([](List& list) { return list.back_if_any(); });
+  }
+
+  /// Total number of elements in all sub-lists.
+  size_t size() const noexcept {
+    size_t result = 0;
+    for (const auto& list : lists_) {
+      result += list->size();
+    }
+    return result;
+  }
+
+  /// Returns true if every sub-list is empty.
+  bool empty() const noexcept {
+    for (const auto& list : lists_) {
+      if (!list->empty()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Inserts element at the beginning of the local sub-list.
+  void push_front(T val) noexcept { local().push_front(std::move(val)); }
+
+  /// Inserts element at the end of the local sub-list.
+  void push_back(T val) noexcept { local().push_back(std::move(val)); }
+
+  /// Inserts element that expires after ttl at the beginning of the local
+  /// sub-list.
+  void push_front_with_ttl(T val,
+                           std::chrono::steady_clock::duration ttl) noexcept {
+    local().push_front_with_ttl(std::move(val), ttl);
+  }
+
+  /// Inserts element that expires after ttl at the end of the local
+  /// sub-list.
+  void push_back_with_ttl(T val,
+                          std::chrono::steady_clock::duration ttl) noexcept {
+    local().push_back_with_ttl(std::move(val), ttl);
+  }
+
+  /// Same as push_front() unless the local sub-list lock is taken, see
+  /// ThreadSafeList2D::try_push_front().
+  ListStatus try_push_front(T val) noexcept {
+    return local().try_push_front(std::move(val));
+  }
+
+  /// Same as push_back() unless the local sub-list lock is taken.
+  ListStatus try_push_back(T val) noexcept {
+    return local().try_push_back(std::move(val));
+  }
+
+  /// Same as try_push_front() but waits for the lock at most timeout.
+  ListStatus try_push_front_for(
+      T val, std::chrono::steady_clock::duration timeout) noexcept {
+    return local().try_push_front_for(std::move(val), timeout);
+  }
+
+  /// Same as try_push_back() but waits for the lock at most timeout.
+  ListStatus try_push_back_for(
+      T val, std::chrono::steady_clock::duration timeout) noexcept {
+    return local().try_push_back_for(std::move(val), timeout);
+  }
+
+  /** \brief Method removes the first element equal to val.
+   *
+   * The local sub-list is searched first.
+   *
+   * \warning throws ElementNotFound exception if no sub-list contains val.
+   */
+  void remove(const T& val) {
+    size_t home = home_index();
+    for (size_t i = 0; i < lists_.size(); ++i) {
+      if (lists_[(home + i) % lists_.size()]->remove_if_present(val)) {
+        return;
+      }
+    }
+    throw ElementNotFound();
+  }
+
+  /** \brief Method removes the first element and returns its value.
+   *
+   * Steals from another sub-list if the local one is empty.
+   *
+   * \warning throws AcceessViolation exception if every sub-list is empty.
+   */
+  T pop_front() {
+    return visit([](List& list) { return list.pop_front_if_any(); });
+  }
+
+  /// Same as pop_front() but removes the last element of the sub-list.
+  T pop_back() {
+    return visit([](List& list) { return list.pop_back_if_any(); });
+  }
+
+  /** \brief Method removes element by value, skipping busy sub-lists.
+   *
+   * \return Outputs ListStatus::Ok if some sub-list removed val,
+   * ListStatus::Busy if it was not found in the others, ListStatus::NotFound
+   * if no sub-list contains it.
+   */
+  ListStatus try_remove(const T& val) {
+    return try_visit(ListStatus::NotFound,
+                     [&val](List& list) { return list.try_remove(val); });
+  }
+
+  /** \brief Method removes the first element, skipping busy sub-lists.
+   * \param out receives the value of the removed node
+   *
+   * \return Outputs ListStatus::Ok, ListStatus::Busy if every sub-list that
+   * was not empty was busy, ListStatus::Empty otherwise.
+   */
+  ListStatus try_pop_front(T& out) {
+    return try_visit(ListStatus::Empty,
+                     [&out](List& list) { return list.try_pop_front(out); });
+  }
+
+  /// Same as try_pop_front() but removes the last element of the sub-list.
+  ListStatus try_pop_back(T& out) {
+    return try_visit(ListStatus::Empty,
+                     [&out](List& list) { return list.try_pop_back(out); });
+  }
+
+  /// Same as try_remove() but waits at most timeout for the sub-list locks
+  /// together; ListStatus::Timeout instead of ListStatus::Busy.
+  ListStatus try_remove_for(const T& val,
+                            std::chrono::steady_clock::duration timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    return try_visit(ListStatus::NotFound, [&val, deadline](List& list) {
+      return list.try_remove_for(val, left(deadline));
+    });
+  }
+
+  /// Same as try_pop_front() but waits at most timeout for the sub-list
+  /// locks together; ListStatus::Timeout instead of ListStatus::Busy.
+  ListStatus try_pop_front_for(T& out,
+                               std::chrono::steady_clock::duration timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    return try_visit(ListStatus::Empty, [&out, deadline](List& list) {
+      return list.try_pop_front_for(out, left(deadline));
+    });
+  }
+
+  /// Same as try_pop_front_for() but removes the last element.
+  ListStatus try_pop_back_for(T& out,
+                              std::chrono::steady_clock::duration timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    return try_visit(ListStatus::Empty, [&out, deadline](List& list) {
+      return list.try_pop_back_for(out, left(deadline));
+    });
+  }
+
+  /// Sets the time to live of elements added from now on to every
+  /// sub-list, see ThreadSafeList2D::set_ttl().
+  void set_ttl(std::chrono::steady_clock::duration ttl) noexcept {
+    for (auto& list : lists_) {
+      list->set_ttl(ttl);
+    }
+  }
+
+  /// Removes expired elements from every sub-list, see
+  /// ThreadSafeList2D::expire(); returns how many were removed in all.
+  size_t expire(std::chrono::steady_clock::time_point now =
+                    std::chrono::steady_clock::now()) {
+    size_t result = 0;
+    for (auto& list : lists_) {
+      result += list->expire(now);
+    }
+    return result;
+  }
+
+#ifdef TESTING_MODE
+  /// Need to iterate forward the sub-lists in node order and get vector of
+  /// their values (for testing purposes only).
+  std::vector<T> get_fwd() {
+    std::vector<T> result;
+    for (auto& list : lists_) {
+      std::vector<T> part = list->get_fwd();
+      result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+  }
+
+  /// Need to iterate backward the sub-lists in reverse node order and get
+  /// vector of their values (for testing purposes only).
+  std::vector<T> get_bwd() {
+    std::vector<T> result;
+    for (size_t i = lists_.size(); i-- > 0;) {
+      std::vector<T> part = lists_[i]->get_bwd();
+      result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+  }
+#endif
+
+  /// Number of sub-lists.
+  size_t node_count() const noexcept { return lists_.size(); }
+
+  /// Sub-list of the given NUMA node.
+  List& sub_list(size_t node) noexcept { return *lists_[node]; }
+
+ private:
+  std::vector<std::unique_ptr<List>> lists_;  /// one per NUMA node
+
+  size_t home_index() const noexcept {
+    return current_numa_node() % lists_.size();
+  }
+
+  List& local() noexcept { return *lists_[home_index()]; }
+
+  /// Applies op, one of the _if_any methods, to the local sub-list or, if it
+  /// is empty, to the nearest non-empty one. The emptiness check and the
+  /// operation are one atomic step of the sub-list.
+  template <class Op>
+  T visit(Op op) {
+    size_t home = home_index();
+    for (size_t i = 0; i < lists_.size(); ++i) {
+      std::optional<T> result = op(*lists_[(home + i) % lists_.size()]);
+      if (result) {
+        return std::move(*result);
+      }
+    }
+    throw AcceessViolation();
+  }
+
+  /// Applies op, one of the try_ methods, to the sub-lists starting with the
+  /// local one until it succeeds. missing is the status of a sub-list that
+  /// has nothing to remove; a busy sub-list is reported over it.
+  template <class Op>
+  ListStatus try_visit(ListStatus missing, Op op) {
+    size_t home = home_index();
+    ListStatus result = missing;
+    for (size_t i = 0; i < lists_.size(); ++i) {
+      ListStatus status = op(*lists_[(home + i) % lists_.size()]);
+      if (status == ListStatus::Ok) {
+        return status;
+      }
+      if (status != missing) {
+        result = status;
+      }
+    }
+    return result;
+  }
+
+  /// Time left until deadline, zero once it passed.
+  static std::chrono::steady_clock::duration left(
+      std::chrono::steady_clock::time_point deadline) noexcept {
+    return std::max(deadline - std::chrono::steady_clock::now(),
+                    std::chrono::steady_clock::duration::zero());
+  }
+};
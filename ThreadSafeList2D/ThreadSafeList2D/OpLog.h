@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * \struct LogOverflow
+ *
+ *
+ * \brief Simple struct for LogOverflow exception
+ *
+ * The exception returns string "Operation log overflow". It is thrown when a
+ * replica finds a gap in the sequence numbers of an operation log, i.e. the
+ * producer had to drop records because the ring buffer was full. The replica
+ * has to be rebuilt from a full snapshot in that case.
+ *
+ *
+ * \author $Author: Liliya Makhmutova $
+ *
+ * \version $Revision: 1.0 $
+ *
+ * \date $Date: 2021/01/16 00:00:00 $
+ */
+struct LogOverflow : public std::exception {
+  /// main method that returns message
+  const char* what() const throw() { return "Operation log overflow"; }
+};
+
+/// Kind of a mutating list operation recorded in an OpLog.
+enum class ListOp : uint8_t {
+  PushFront,
+  PushBack,
+  Remove,
+  PopFront,
+  PopBack,
+  InsertAt,
+  EraseAt
+};
+
+/// Single entry of an OpLog.
+template <class T>
+struct OpRecord {
+  uint64_t sequence;  /// 1 for the first operation, gaps mean lost records
+  ListOp op;
+  T value;  /// argument of push/remove, popped value for pop
+  uint64_t position;  /// index of InsertAt and EraseAt, 0 otherwise
+};
+
+/**
+ * \class OpLog
+ *
+ *
+ * \brief Append-only log of list operations kept in a lock-free ring buffer.
+ *
+ * \tparam T Class stored in the logged list.
+ *
+ * The ring has a single producer and a single consumer. The producer is the
+ * list the log is attached to (its own mutex serializes appends), the
+ * consumer is whoever ships or replays the records. Neither side ever
+ * blocks: when the ring is full the record is dropped, but its sequence
+ * number is still used up, so the consumer sees the gap.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class T>
+class OpLog {
+  struct Slot {
+    alignas(OpRecord<T>) unsigned char storage[sizeof(OpRecord<T>)];
+  };
+
+ public:
+  /// Creates a log for at least capacity records (rounded up to power of 2).
+  explicit OpLog(size_t capacity = 1024)
+      : capacity_(round_up(capacity)),
+        slots_(new Slot[capacity_]),
+        sequence_(0),
+        head_(0),
+        tail_(0) {}
+
+  OpLog(const OpLog& rhs) = delete;
+  OpLog& operator=(const OpLog& rhs) = delete;
+
+  ~OpLog() {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    for (size_t head = head_.load(std::memory_order_relaxed); head != tail;
+         ++head) {
+      record(head)->~OpRecord<T>();
+    }
+  }
+
+  /** \brief Producer side: appends a record with the next sequence number.
+   *
+   * \return false if the ring is full and the record was dropped.
+   */
+  bool append(ListOp op, const T& value, uint64_t position = 0) {
+    uint64_t sequence = ++sequence_;
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == capacity_) {
+      return false;
+    }
+    new (slots_[tail & (capacity_ - 1)].storage)
+        OpRecord<T>{sequence, op, value, position};
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** \brief Consumer side: passes every available record to fn in order.
+   * \param fn callable invoked as fn(const OpRecord<T>&)
+   *
+   * A record is consumed even if fn throws for it.
+   *
+   * \return number of consumed records.
+   */
+  template <class Fn>
+  size_t drain(Fn&& fn) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t consumed = 0;
+    while (head != tail) {
+      struct Release {
+        OpLog* log;
+        size_t head;
+        ~Release() {
+          log->consumed_ = log->record(head)->sequence;
+          log->record(head)->~OpRecord<T>();
+          log->head_.store(head + 1, std::memory_order_release);
+        }
+      } release{this, head};
+      ++head;
+      ++consumed;
+      fn(static_cast<const OpRecord<T>&>(*record(head - 1)));
+    }
+    return consumed;
+  }
+
+  /// Consumer side: sequence number of the last consumed record, 0 if none.
+  uint64_t consumed_sequence() const noexcept { return consumed_; }
+
+  /// Number of records the ring can hold.
+  size_t capacity() const noexcept { return capacity_; }
+
+ private:
+  const size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  uint64_t sequence_;  /// written by the producer only
+  uint64_t consumed_ = 0;  /// written by the consumer only
+  alignas(64) std::atomic<size_t> head_;  /// next record to consume
+  alignas(64) std::atomic<size_t> tail_;  /// next free slot
+
+  OpRecord<T>* record(size_t position) noexcept {
+    return reinterpret_cast<OpRecord<T>*>(
+        slots_[position & (capacity_ - 1)].storage);
+  }
+
+  static size_t round_up(size_t capacity) noexcept {
+    size_t result = 1;
+    while (result < capacity) {
+      result <<= 1;
+    }
+    return result;
+  }
+};
@@ -0,0 +1,580 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ThreadSafeList2D.h"
+
+/**
+ * \struct StorageError
+ *
+ *
+ * \brief Simple struct for StorageError exception
+ *
+ * The exception returns string "Storage error". It is thrown when the backing
+ * file of a PersistentList2D cannot be opened, resized or mapped, or when it
+ * does not contain a list of the expected element type.
+ *
+ *
+ * \author $Author: Liliya Makhmutova $
+ *
+ * \version $Revision: 1.0 $
+ *
+ * \date $Date: 2021/01/16 00:00:00 $
+ */
+struct StorageError : public std::exception {
+  /// main method that returns message
+  const char* what() const throw() { return "Storage error"; }
+};
+
+/**
+ * \class MappedFile
+ *
+ *
+ * \brief Read-write memory mapping of a whole file that can grow.
+ *
+ * Growing the file remaps it, so callers must not keep raw pointers into
+ * data() across resize(). The file is opened exclusively (share mode 0 on
+ * Windows, an flock elsewhere): while it is mapped, any other open of the
+ * same file, also from the same process, fails.
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+class MappedFile {
+ public:
+  /// Opens (or creates an empty) file and maps its current contents, throws
+  /// StorageError if the file is already open.
+  explicit MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      throw StorageError();
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+      CloseHandle(file_);
+      throw StorageError();
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    mapping_ = nullptr;
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw StorageError();
+    }
+    struct stat info;
+    if (::flock(fd_, LOCK_EX | LOCK_NB) != 0 || ::fstat(fd_, &info) != 0) {
+      ::close(fd_);
+      throw StorageError();
+    }
+    size_ = static_cast<size_t>(info.st_size);
+#endif
+    if (size_ > 0) {
+      try {
+        map();
+      } catch (...) {
+        close_file();
+        throw;
+      }
+    }
+  }
+
+  MappedFile(const MappedFile& rhs) = delete;
+  MappedFile& operator=(const MappedFile& rhs) = delete;
+
+  ~MappedFile() {
+    unmap();
+    close_file();
+  }
+
+  /// Start of the mapping, nullptr while the file is empty.
+  char* data() noexcept { return data_; }
+
+  /// Current file (and mapping) size in bytes.
+  size_t size() const noexcept { return size_; }
+
+  /** \brief Grows the file to bytes and maps it again.
+   *
+   * \warning throws StorageError, the old mapping stays valid in that case.
+   */
+  void resize(size_t bytes) {
+    if (bytes <= size_) {
+      return;
+    }
+#ifdef _WIN32
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(bytes);
+    if (!SetFilePointerEx(file_, position, nullptr, FILE_BEGIN)) {
+      throw StorageError();
+    }
+    unmap();  // the file cannot be extended while a view is mapped
+    if (!SetEndOfFile(file_)) {
+      map();
+      throw StorageError();
+    }
+#else
+    if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+      throw StorageError();
+    }
+    unmap();
+#endif
+    size_ = bytes;
+    map();
+  }
+
+  /// Flushes dirty pages of the mapping to the storage device.
+  void sync() {
+    if (!data_) {
+      return;
+    }
+#ifdef _WIN32
+    if (!FlushViewOfFile(data_, 0) || !FlushFileBuffers(file_)) {
+      throw StorageError();
+    }
+#else
+    if (::msync(data_, size_, MS_SYNC) != 0) {
+      throw StorageError();
+    }
+#endif
+  }
+
+ private:
+#ifdef _WIN32
+  HANDLE file_;
+  HANDLE mapping_;
+#else
+  int fd_;
+#endif
+  char* data_;
+  size_t size_;
+
+  void map() {
+#ifdef _WIN32
+    mapping_ =
+        CreateFileMappingA(file_, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!mapping_) {
+      throw StorageError();
+    }
+    data_ = static_cast<char*>(
+        MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size_));
+    if (!data_) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+      throw StorageError();
+    }
+#else
+    void* address =
+        ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (address == MAP_FAILED) {
+      throw StorageError();
+    }
+    data_ = static_cast<char*>(address);
+#endif
+  }
+
+  void unmap() noexcept {
+    if (!data_) {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    ::munmap(data_, size_);
+#endif
+    data_ = nullptr;
+  }
+
+  void close_file() noexcept {
+#ifdef _WIN32
+    CloseHandle(file_);
+#else
+    ::close(fd_);
+#endif
+  }
+};
+
+/**
+ * \class PersistentList2D
+ *
+ *
+ * \brief Thread safe doubly linked list that lives in a memory-mapped file.
+ *
+ * \tparam T Trivially copyable class to store in the linked list.
+ *
+ * Nodes are slots of the mapped file and link to each other by byte offsets
+ * from the start of the mapping, so the same file can be mapped at any
+ * address. Reopening a file that was closed cleanly gives the list back in
+ * O(1): nothing is read besides the header.
+ *
+ * Link updates are ordered so that the forward chain from head is always a
+ * valid list: a node is fully written before it becomes reachable, and it is
+ * made unreachable before it is recycled. prev links, tail, size and the free
+ * slot chain are derived from it. If the process dies in the middle of an
+ * update, the next open sees the dirty flag and rebuilds them with one walk
+ * of the chain; nodes that were being inserted or removed at the moment of
+ * the crash are either fully in the list or back in the free chain.
+ *
+ * The ordering protects against a crash of the process, the kernel still
+ * writes pages back in any order. Call sync() at the points where the content
+ * has to survive a power loss as well.
+ *
+ * Copy constructor and copy assignment operations are restricted (deleted).
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class T>
+class PersistentList2D {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "PersistentList2D requires a trivially copyable type");
+
+  /// Node slot inside the file, links are offsets and 0 means "none".
+  struct Node {
+    uint64_t prev;
+    uint64_t next;
+    T value;
+  };
+
+  /// First bytes of the file.
+  struct alignas(64) Header {
+    char magic[8];
+    uint32_t element_size;
+    uint32_t dirty;  /// set while the file is open
+    uint64_t capacity;  /// number of node slots in the file
+    uint64_t used;      /// slots ever handed out, the rest are untouched
+    uint64_t head;
+    uint64_t tail;
+    uint64_t size;
+    uint64_t free_head;  /// chain of recycled slots linked through next
+  };
+
+  static constexpr size_t kSlotsOffset =
+      (sizeof(Header) + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+
+ public:
+  /** \brief Opens the list stored at path, creating an empty one if needed.
+   * \param path backing file
+   * \param initial_capacity number of node slots of a newly created file
+   *
+   * \warning throws StorageError if the file cannot be mapped or belongs to a
+   * list of another element type.
+   */
+  explicit PersistentList2D(const std::string& path,
+                            size_t initial_capacity = 1024)
+      : file_(path) {
+    if (file_.size() == 0) {
+      if (initial_capacity == 0) {
+        initial_capacity = 1;
+      }
+      file_.resize(kSlotsOffset + initial_capacity * sizeof(Node));
+      Header* header = this->header();
+      std::memcpy(header->magic, "TSL2PERS", sizeof(header->magic));
+      header->element_size = sizeof(T);
+      header->capacity = initial_capacity;
+      file_.sync();
+    }
+    Header* header = this->header();
+    if (file_.size() < kSlotsOffset ||
+        std::memcmp(header->magic, "TSL2PERS", sizeof(header->magic)) != 0 ||
+        header->element_size != sizeof(T) ||
+        kSlotsOffset + header->capacity * sizeof(Node) > file_.size()) {
+      throw StorageError();
+    }
+    if (header->dirty) {
+      recover();
+    }
+    header->dirty = 1;
+  }
+
+  /// Copy constructor is disabled
+  PersistentList2D(const PersistentList2D<T>& rhs) = delete;
+  /// Copy assignment is disabled
+  PersistentList2D& operator=(const PersistentList2D<T>& rhs) = delete;
+
+  /// Flushes the mapping and marks the file as cleanly closed.
+  ~PersistentList2D() {
+    try {
+      file_.sync();
+      header()->dirty = 0;
+      file_.sync();
+    } catch (...) {
+      // the dirty flag stays set, the next open recovers the file
+    }
+  }
+
+  /** \brief Method that returns the value of the first element.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T front() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header()->head) {
+      throw AcceessViolation();
+    }
+    return node(header()->head)->value;
+  }
+
+  /** \brief Method that returns the value of the last element.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T back() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header()->tail) {
+      throw AcceessViolation();
+    }
+    return node(header()->tail)->value;
+  }
+
+  /** \brief Method that returns the size of the list.
+   *
+   * \warning this function uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  size_t size() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<size_t>(header()->size);
+  }
+
+  /** \brief Method that returns true if list is empty.
+   *
+   * \warning this function uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  bool empty() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return header()->size == 0;
+  }
+
+  /** \brief Method inserts element at the beginning.
+   * \param val value that will be added to the list
+   *
+   * The new node is written completely and points to the old head before
+   * head is switched to it.
+   *
+   * \warning this function uses mutex lock_guard and throws StorageError if
+   * the file has to grow and cannot.
+   */
+  void push_front(T val) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t offset = allocate_slot();
+    Header* header = this->header();
+    Node* fresh = node(offset);
+    fresh->value = val;
+    fresh->prev = 0;
+    fresh->next = header->head;
+    publish();
+    header->head = offset;  // commit point
+    publish();
+    if (fresh->next) {
+      node(fresh->next)->prev = offset;
+    } else {
+      header->tail = offset;
+    }
+    header->size++;
+  }
+
+  /** \brief Method inserts element at the end.
+   * \param val value that will be added to the list
+   *
+   * The new node is written completely before the old tail is linked to it.
+   *
+   * \warning this function uses mutex lock_guard and throws StorageError if
+   * the file has to grow and cannot.
+   */
+  void push_back(T val) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t offset = allocate_slot();
+    Header* header = this->header();
+    Node* fresh = node(offset);
+    fresh->value = val;
+    fresh->prev = header->tail;
+    fresh->next = 0;
+    publish();
+    if (header->tail) {
+      node(header->tail)->next = offset;  // commit point
+    } else {
+      header->head = offset;  // commit point
+    }
+    publish();
+    header->tail = offset;
+    header->size++;
+  }
+
+  /** \brief Method removes element from the list by value.
+   * \param val value that will be removed
+   *
+   * The node is unlinked from the forward chain first, the backward links are
+   * fixed afterwards and only then the slot goes to the free chain.
+   *
+   * \warning this function uses mutex lock_guard and throws ElementNotFound.
+   */
+  void remove(T val) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Header* header = this->header();
+    uint64_t offset = header->head;
+    while (offset && !(node(offset)->value == val)) {
+      offset = node(offset)->next;
+    }
+    if (!offset) {
+      throw ElementNotFound();
+    }
+
+    Node* found = node(offset);
+    if (found->prev) {
+      node(found->prev)->next = found->next;  // commit point
+    } else {
+      header->head = found->next;  // commit point
+    }
+    publish();
+    if (found->next) {
+      node(found->next)->prev = found->prev;
+    } else {
+      header->tail = found->prev;
+    }
+    header->size--;
+    publish();
+    found->next = header->free_head;
+    publish();
+    header->free_head = offset;
+  }
+
+  /// Flushes the mapped file so that the current content survives power loss.
+  void sync() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.sync();
+  }
+
+#ifdef TESTING_MODE
+  /// Need to iterate forward the list and get vector of list values (for
+  /// testing purposes only).
+  std::vector<T> get_fwd() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<T> result;
+    for (uint64_t offset = header()->head; offset;
+         offset = node(offset)->next) {
+      result.push_back(node(offset)->value);
+    }
+    return result;
+  }
+
+  /// Need to iterate backward the list and get vector of list values (for
+  /// testing purposes only).
+  std::vector<T> get_bwd() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<T> result;
+    for (uint64_t offset = header()->tail; offset;
+         offset = node(offset)->prev) {
+      result.push_back(node(offset)->value);
+    }
+    return result;
+  }
+#endif
+
+ private:
+  MappedFile file_;
+  std::mutex mutex_;  /// to use std::lock_guard
+
+  Header* header() noexcept { return reinterpret_cast<Header*>(file_.data()); }
+
+  Node* node(uint64_t offset) noexcept {
+    return reinterpret_cast<Node*>(file_.data() + offset);
+  }
+
+  static uint64_t slot_offset(uint64_t index) noexcept {
+    return kSlotsOffset + index * sizeof(Node);
+  }
+
+  /// Keeps the compiler from reordering stores into the mapping around it.
+  static void publish() noexcept {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+
+  /// Takes a slot from the free chain or from the untouched tail of the file.
+  uint64_t allocate_slot() {
+    Header* header = this->header();
+    if (header->free_head) {
+      uint64_t offset = header->free_head;
+      header->free_head = node(offset)->next;
+      return offset;
+    }
+    if (header->used == header->capacity) {
+      uint64_t capacity = header->capacity * 2;
+      file_.resize(static_cast<size_t>(slot_offset(capacity)));
+      header = this->header();
+      header->capacity = capacity;
+    }
+    return slot_offset(header->used++);
+  }
+
+  /// Rebuilds derived state after the file was not closed cleanly.
+  void recover() {
+    Header* header = this->header();
+    if (header->used > header->capacity) {
+      throw StorageError();  // slots past the file end, see the constructor
+    }
+    uint64_t limit = slot_offset(header->used);
+    std::vector<bool> linked(static_cast<size_t>(header->used), false);
+
+    uint64_t prev = 0;
+    uint64_t size = 0;
+    for (uint64_t offset = header->head; offset; offset = node(offset)->next) {
+      if (offset < kSlotsOffset || offset >= limit ||
+          (offset - kSlotsOffset) % sizeof(Node) != 0 ||
+          linked[static_cast<size_t>((offset - kSlotsOffset) / sizeof(Node))]) {
+        throw StorageError();  // the forward chain itself is damaged
+      }
+      linked[static_cast<size_t>((offset - kSlotsOffset) / sizeof(Node))] =
+          true;
+      node(offset)->prev = prev;
+      prev = offset;
+      ++size;
+    }
+    header->tail = prev;
+    header->size = size;
+
+    header->free_head = 0;
+    for (uint64_t index = header->used; index-- > 0;) {
+      if (!linked[static_cast<size_t>(index)]) {
+        node(slot_offset(index))->next = header->free_head;
+        header->free_head = slot_offset(index);
+      }
+    }
+    file_.sync();
+  }
+};
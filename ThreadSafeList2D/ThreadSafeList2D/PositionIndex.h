@@ -0,0 +1,263 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * \class PositionIndex
+ *
+ *
+ * \brief Sequence of items with logarithmic positional lookup.
+ *
+ * \tparam Item Cheap to copy item type, e.g. a node pointer.
+ *
+ * Items are kept in blocks of at most 2 * kBlock entries, and a Fenwick
+ * tree over the block sizes finds the block of a position in O(log n).
+ * Inserting or erasing inside a block shifts that block only, O(kBlock).
+ * The first block keeps free room in front of its items, so pushes and
+ * pops at either end are amortized O(log n). Splitting a full block,
+ * merging an underfull one into a neighbour or dropping an empty one
+ * rebuilds the tree in O(n / kBlock), which happens at most once per
+ * kBlock / 2 updates of a block, also when pushes and pops alternate at
+ * a block boundary. The class is not synchronized;
+ * ThreadSafeList2D uses it under its lock to answer at(), insert_at() and
+ * erase_at().
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class Item>
+class PositionIndex {
+  /// Items first..items.size() of a block are in use.
+  struct Block {
+    std::vector<Item> items;
+    size_t first = 0;
+
+    size_t size() const noexcept { return items.size() - first; }
+  };
+
+ public:
+  /// Nominal number of items per block.
+  static constexpr size_t kBlock = 1024;
+
+  /// Number of items.
+  size_t size() const noexcept { return size_; }
+
+  /// Removes all items.
+  void clear() noexcept {
+    blocks_.clear();
+    tree_.clear();
+    size_ = 0;
+  }
+
+  /// First item, the index must not be empty.
+  const Item& front() const noexcept {
+    return blocks_.front().items[blocks_.front().first];
+  }
+
+  /// Last item, the index must not be empty.
+  const Item& back() const noexcept { return blocks_.back().items.back(); }
+
+  /// Item at position, which must be less than size().
+  const Item& at(size_t position) const noexcept {
+    std::pair<size_t, size_t> place = locate(position);
+    const Block& block = blocks_[place.first];
+    return block.items[block.first + place.second];
+  }
+
+  /// Appends item.
+  void push_back(Item item) {
+    if (blocks_.empty()) {
+      Block block;
+      block.items.reserve(kBlock);
+      tree_.reserve(2);
+      blocks_.push_back(std::move(block));
+      append_to_tree();
+    }
+    blocks_.back().items.push_back(item);
+    add(blocks_.size() - 1, 1);
+    ++size_;
+    if (blocks_.back().size() > 2 * kBlock) {
+      split(blocks_.size() - 1);
+    }
+  }
+
+  /// Prepends item.
+  void push_front(Item item) {
+    if (blocks_.empty()) {
+      push_back(item);
+      return;
+    }
+    Block& block = blocks_.front();
+    if (block.first == 0) {  // make room for kBlock pushes in front
+      std::vector<Item> items(kBlock);
+      items.reserve(kBlock + block.items.size());
+      items.insert(items.end(), block.items.begin(), block.items.end());
+      block.items.swap(items);
+      block.first = kBlock;
+    }
+    block.items[--block.first] = item;
+    add(0, 1);
+    ++size_;
+    if (block.size() > 2 * kBlock) {
+      split(0);
+    }
+  }
+
+  /// Inserts item so that it ends up at position (at most size()).
+  void insert(size_t position, Item item) {
+    if (position == size_) {
+      push_back(item);
+      return;
+    }
+    std::pair<size_t, size_t> place = locate(position);
+    Block& block = blocks_[place.first];
+    block.items.insert(block.items.begin() + block.first + place.second,
+                       item);
+    add(place.first, 1);
+    ++size_;
+    if (block.size() > 2 * kBlock) {
+      split(place.first);
+    }
+  }
+
+  /// Removes the item at position (less than size()).
+  void erase(size_t position) noexcept {
+    std::pair<size_t, size_t> place = locate(position);
+    Block& block = blocks_[place.first];
+    block.items.erase(block.items.begin() + block.first + place.second);
+    add(place.first, size_t(0) - 1);
+    --size_;
+    settle(place.first);
+  }
+
+  /// Removes the first item, the index must not be empty.
+  void pop_front() noexcept {
+    ++blocks_.front().first;
+    add(0, size_t(0) - 1);
+    --size_;
+    settle(0);
+  }
+
+  /// Removes the last item, the index must not be empty.
+  void pop_back() noexcept {
+    blocks_.back().items.pop_back();
+    add(blocks_.size() - 1, size_t(0) - 1);
+    --size_;
+    settle(blocks_.size() - 1);
+  }
+
+ private:
+  std::vector<Block> blocks_;  /// none of them is empty
+  std::vector<size_t> tree_;   /// Fenwick tree of block sizes, 1-based
+  size_t size_ = 0;
+
+  /// Returns the block holding position and the offset within it.
+  std::pair<size_t, size_t> locate(size_t position) const noexcept {
+    size_t block = 0;  // number of whole blocks before position
+    size_t step = 1;
+    while (2 * step <= blocks_.size()) {
+      step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+      if (block + step <= blocks_.size() && tree_[block + step] <= position) {
+        block += step;
+        position -= tree_[block];
+      }
+    }
+    return {block, position};
+  }
+
+  /// Adds delta (modulo 2^N, so size_t(0) - 1 subtracts) to a block size.
+  void add(size_t block, size_t delta) noexcept {
+    for (size_t i = block + 1; i < tree_.size(); i += i & (0 - i)) {
+      tree_[i] += delta;
+    }
+  }
+
+  /// Extends the tree to a block just appended empty. Its capacity must
+  /// suffice.
+  void append_to_tree() noexcept {
+    if (tree_.empty()) {
+      tree_.push_back(0);
+    }
+    size_t i = tree_.size();  // covers blocks (i - lowbit(i), i]
+    size_t sum = 0;
+    for (size_t step = 1; step < (i & (0 - i)); step *= 2) {
+      sum += tree_[i - step];
+    }
+    tree_.push_back(sum);
+  }
+
+  /// Recomputes the tree after blocks were inserted or removed. Its
+  /// capacity must suffice.
+  void rebuild() noexcept {
+    tree_.assign(blocks_.size() + 1, 0);
+    for (size_t i = 1; i < tree_.size(); ++i) {
+      tree_[i] += blocks_[i - 1].size();
+      size_t parent = i + (i & (0 - i));
+      if (parent < tree_.size()) {
+        tree_[parent] += tree_[i];
+      }
+    }
+  }
+
+  /// Moves the items of a block past its first kBlock into a new block
+  /// behind it. The block is left as it was if this throws.
+  void split(size_t index) {
+    Block upper;
+    upper.items.assign(blocks_[index].items.begin() + blocks_[index].first +
+                           kBlock,
+                       blocks_[index].items.end());
+    const size_t moved = upper.items.size();
+    tree_.reserve(blocks_.size() + 2);
+    blocks_.insert(blocks_.begin() + index + 1, std::move(upper));
+    Block& lower = blocks_[index];
+    lower.items.resize(lower.first + kBlock);
+    if (index + 2 == blocks_.size()) {  // the last block, no need to rebuild
+      add(index, 0 - moved);
+      append_to_tree();
+      add(index + 1, moved);
+    } else {
+      rebuild();
+    }
+  }
+
+  /// Drops a block that became empty or merges an underfull one into a
+  /// neighbour, if the neighbour has room without reallocating.
+  void settle(size_t index) noexcept {
+    Block& block = blocks_[index];
+    if (block.size() == 0) {
+      blocks_.erase(blocks_.begin() + index);
+    } else if (block.size() >= kBlock / 2 || !merge(index)) {
+      return;
+    }
+    rebuild();
+  }
+
+  bool merge(size_t index) noexcept {
+    return (index > 0 && merge_pair(index - 1)) ||
+           (index + 1 < blocks_.size() && merge_pair(index));
+  }
+
+  /// Moves block left + 1 to the end of block left if both fit into one
+  /// nominal block and the storage of left.
+  bool merge_pair(size_t left) noexcept {
+    Block& into = blocks_[left];
+    Block& from = blocks_[left + 1];
+    size_t total = into.size() + from.size();
+    if (total > kBlock || total > into.items.capacity()) {
+      return false;
+    }
+    into.items.erase(into.items.begin(), into.items.begin() + into.first);
+    into.first = 0;
+    into.items.insert(into.items.end(), from.items.begin() + from.first,
+                      from.items.end());
+    blocks_.erase(blocks_.begin() + left + 1);
+    return true;
+  }
+};
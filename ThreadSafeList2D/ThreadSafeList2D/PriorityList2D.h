@@ -0,0 +1,261 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "AdaptiveMutex.h"
+#include "NodePool.h"
+#include "ThreadSafeList2D.h"
+
+/**
+ * \class PriorityList2D
+ *
+ *
+ * \brief Thread safe list whose elements are popped by priority.
+ *
+ * \tparam T Class to store in the list.
+ * \tparam Lock Lockable type guarding the list.
+ *
+ * Every priority level from 0 to kLevels - 1 is a doubly linked bucket of
+ * its own, and a 64-bit mask tells which buckets are non-empty. push() links
+ * the element after the tail of its bucket, pop_highest() finds the highest
+ * non-empty bucket with a single bit scan and unlinks its head, so both are
+ * O(1) however many levels are in use. Elements of one priority come out in
+ * the order they were pushed. Nodes are taken from the NodePool shared by
+ * all lists of the same element type.
+ *
+ * Copy constructor and copy assignment operations are restricted (deleted).
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class T, class Lock = AdaptiveMutex>
+class PriorityList2D {
+  /// Element of a bucket, next comes first as in ThreadSafeList2D.
+  struct Node {
+    Node* next;
+    Node* prev;
+    T value;
+  };
+
+  /// Doubly linked list of the elements of one priority.
+  struct Bucket {
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    size_t size = 0;
+  };
+
+ public:
+  /// Number of priority levels, 0 is the lowest.
+  static constexpr size_t kLevels = 64;
+
+  /// Simple constructor, initially list is empty
+  PriorityList2D() noexcept : mask_(0), size_(0) {}
+
+  /// Copy constructor is disabled
+  PriorityList2D(const PriorityList2D& rhs) = delete;
+  /// Copy assignment is disabled
+  PriorityList2D& operator=(const PriorityList2D& rhs) = delete;
+
+  /// Delete all the nodes in destructor
+  ~PriorityList2D() {
+    for (Bucket& bucket : buckets_) {
+      while (bucket.head) {
+        Node* next = bucket.head->next;
+        destroy_node(bucket.head);
+        bucket.head = next;
+      }
+    }
+  }
+
+  /** \brief Method inserts element at the end of its priority bucket.
+   * \param val value that will be added to the list
+   * \param priority level of the element, less than kLevels
+   *
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception if priority >= kLevels.
+   */
+  void push(T val, size_t priority) {
+    if (priority >= kLevels) {
+      throw AcceessViolation();
+    }
+    Node* node = create_node(std::move(val));
+    std::lock_guard<Lock> lock(mutex_);
+    Bucket& bucket = buckets_[priority];
+    node->prev = bucket.tail;
+    if (bucket.tail) {
+      bucket.tail->next = node;
+    } else {
+      bucket.head = node;
+      mask_ |= uint64_t(1) << priority;
+    }
+    bucket.tail = node;
+    ++bucket.size;
+    ++size_;
+  }
+
+  /** \brief Method removes the oldest element of the highest priority.
+   *
+   *
+   * \return Outputs value of the removed node.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T pop_highest() {
+    std::lock_guard<Lock> lock(mutex_);
+    if (mask_ == 0) {
+      throw AcceessViolation();
+    }
+    size_t priority = highest_bit(mask_);
+    Node* node = buckets_[priority].head;
+    T value = std::move(node->value);
+    unlink(node, priority);
+    return value;
+  }
+
+  /** \brief Method returns the value pop_highest() would remove.
+   *
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T top() {
+    std::lock_guard<Lock> lock(mutex_);
+    if (mask_ == 0) {
+      throw AcceessViolation();
+    }
+    return buckets_[highest_bit(mask_)].head->value;
+  }
+
+  /** \brief Method returns the highest priority that has elements.
+   *
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  size_t highest_priority() {
+    std::lock_guard<Lock> lock(mutex_);
+    if (mask_ == 0) {
+      throw AcceessViolation();
+    }
+    return highest_bit(mask_);
+  }
+
+  /** \brief Method removes the first element equal to val.
+   * \param val value that will be removed
+   *
+   * Buckets are searched from the highest priority down, so this is the
+   * only O(n) operation.
+   *
+   *
+   * \warning this function uses mutex lock_guard and throws ElementNotFound.
+   */
+  void remove(const T& val) {
+    std::lock_guard<Lock> lock(mutex_);
+    for (uint64_t mask = mask_; mask != 0;) {
+      size_t priority = highest_bit(mask);
+      mask &= ~(uint64_t(1) << priority);
+      for (Node* node = buckets_[priority].head; node; node = node->next) {
+        if (node->value == val) {
+          unlink(node, priority);
+          return;
+        }
+      }
+    }
+    throw ElementNotFound();
+  }
+
+  /** \brief Method that returns the number of elements of all priorities.
+   *
+   * \warning this finction uses mutex lock_guard.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  size_t size() noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    return size_;
+  }
+
+  /** \brief Method that returns the number of elements of one priority.
+   *
+   * \warning this finction uses mutex lock_guard and throws AcceessViolation
+   * exception if priority >= kLevels.
+   */
+  size_t size(size_t priority) {
+    if (priority >= kLevels) {
+      throw AcceessViolation();
+    }
+    std::lock_guard<Lock> lock(mutex_);
+    return buckets_[priority].size;
+  }
+
+  /** \brief Method that returns true if list is empty.
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  bool empty() noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    return mask_ == 0;
+  }
+
+ private:
+  Bucket buckets_[kLevels];
+  uint64_t mask_;  /// bit p is set while bucket p is non-empty
+  size_t size_;
+  mutable Lock mutex_;  /// to use std::lock_guard
+
+  static Node* create_node(T value) {
+    NodePool<Node>& pool = NodePool<Node>::instance();
+    void* storage = pool.allocate();
+    try {
+      return new (storage) Node{nullptr, nullptr, std::move(value)};
+    } catch (...) {
+      pool.deallocate(storage);
+      throw;
+    }
+  }
+
+  static void destroy_node(Node* node) noexcept {
+    node->~Node();
+    NodePool<Node>::instance().deallocate(node);
+  }
+
+  /// Unlinks and frees a node of the given bucket. Must be called under the
+  /// lock.
+  void unlink(Node* node, size_t priority) noexcept {
+    Bucket& bucket = buckets_[priority];
+    (node->prev ? node->prev->next : bucket.head) = node->next;
+    (node->next ? node->next->prev : bucket.tail) = node->prev;
+    if (--bucket.size == 0) {
+      mask_ &= ~(uint64_t(1) << priority);
+    }
+    --size_;
+    destroy_node(node);
+  }
+
+  /// Index of the most significant set bit, mask must not be zero.
+  static size_t highest_bit(uint64_t mask) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<size_t>(__builtin_clzll(mask));
+#else
+    size_t index = 0;
+    while (mask >>= 1) {
+      ++index;
+    }
+    return index;
+#endif
+  }
+};
@@ -1,11 +1,54 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <functional>
+#include <initializer_list>
+#include <istream>
+#include <iterator>
+#include <list>
+#include <memory>
 #include <mutex>
-
-#ifdef TESTING_MODE
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+/// Defined when async_pop_front() is available (C++20 coroutines).
+#define THREAD_SAFE_LIST_COROUTINES
+#endif
 #endif
 
+#include "AdaptiveMutex.h"
+#include "EventNotifier.h"
+#include "MultiLock.h"
+#include "NodePool.h"
+#include "OpLog.h"
+#include "PositionIndex.h"
+
 /**
  * \struct ElementNotFound
  *
@@ -46,6 +89,78 @@ struct AcceessViolation : public std::exception {
   const char* what() const throw() { return "Access violation"; }
 };
 
+/// Outcome of the try_ and _for operations of ThreadSafeList2D.
+enum class ListStatus : uint8_t {
+  Ok,        /// the operation took effect
+  Busy,      /// the lock was taken by another thread, nothing was done
+  Timeout,   /// the lock could not be taken in time, nothing was done
+  NotFound,  /// no element to remove
+  Empty      /// nothing to pop
+};
+
+/**
+ * \struct SerializationError
+ *
+ *
+ * \brief Simple struct for SerializationError exception
+ *
+ * The exception returns string "Serialization error". It is thrown when a
+ * list snapshot cannot be written or when the data read back is malformed.
+ *
+ *
+ * \author $Author: Liliya Makhmutova $
+ *
+ * \version $Revision: 1.0 $
+ *
+ * \date $Date: 2021/01/16 00:00:00 $
+ */
+struct SerializationError : public std::exception {
+  /// main method that returns message
+  const char* what() const throw() { return "Serialization error"; }
+};
+
+/**
+ * \struct TrivialSerializer
+ *
+ *
+ * \brief Default element serializer used by ThreadSafeList2D::save/load.
+ *
+ * \tparam T Trivially copyable class stored in the list.
+ *
+ * Copies the object representation as is, so snapshots are only portable
+ * between builds with the same layout and endianness of T. Lists of other
+ * types pass their own serializer with the same two methods: write() appends
+ * the encoding of a value to a byte string, read() decodes one value from
+ * exactly the bytes that write() produced.
+ *
+ *
+ * \author $Author: Liliya Makhmutova $
+ *
+ * \version $Revision: 1.0 $
+ *
+ * \date $Date: 2021/01/16 00:00:00 $
+ */
+template <class T>
+struct TrivialSerializer {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "TrivialSerializer requires a trivially copyable type");
+
+  /// appends raw bytes of value to out
+  void write(const T& value, std::string& out) const {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  /// restores value from its raw bytes
+  T read(const char* data, size_t size) const {
+    if (size != sizeof(T)) {
+      throw SerializationError();
+    }
+    alignas(T) unsigned char raw[sizeof(T)];
+    std::memcpy(raw, data, sizeof(T));
+    return *reinterpret_cast<T*>(raw);
+  }
+};
+
 /**
  * \class ThreadSafeList2D
  *
@@ -53,9 +168,43 @@ struct AcceessViolation : public std::exception {
  * \brief Implements thread safe doubly linked list data structure.
  *
  * \tparam T Class to store in the linked list.
+ * \tparam Lock Lockable type guarding the list, AdaptiveMutex by default
+ * (std::mutex works as well).
  *
  * ThreadSafeList2D uses std::lock_guard to achieve thread safety.
  * All of the operations are standard for doubly linked list data structure.
+ * Node storage is taken from the shared NodePool, so that nodes are allocated
+ * outside of the lock and bulk loads get contiguous slabs.
+ *
+ * snapshot() gives a read view that is traversed without the lock. Every
+ * mutation bumps a version counter; nodes remember the version that
+ * inserted them and, while snapshots exist, removed nodes are only stamped
+ * with the removing version and stay linked. They are unlinked and freed
+ * once no snapshot can see them any more.
+ *
+ * Every node also keeps a jump pointer to the node kJumpDistance steps
+ * further, set when nodes are linked at the ends: a node pushed to the back
+ * is made the jump target of the node pushed there kJumpDistance pushes
+ * earlier, a node pushed to the front points at the one pushed there
+ * kJumpDistance pushes earlier. Scans only read them and prefetch through
+ * them, so on lists that do not fit in cache many node loads are in flight
+ * at once instead of one per step, and find() never writes to the nodes it
+ * visits. Jump pointers are only hints: a stale one may dangle, even into
+ * a contiguous slab that went back to the system, so it is never
+ * dereferenced and only handed to the prefetch instruction, which does not
+ * fault on any address. A second pointer per node, set the same way, leads
+ * kJumpDistance steps back, so backward scans are prefetched too. Define
+ * THREAD_SAFE_LIST_NO_PREFETCH to turn prefetching off.
+ *
+ * Elements may be given a time to live, see set_ttl(). Expired ones are
+ * removed lazily from the ends and by expire(), no timer runs per element.
+ * Expiry times live in a table beside the nodes, so lists without a TTL
+ * pay no memory for them.
+ *
+ * When compiled as C++20, async_pop_front() lets coroutines wait for an
+ * element without blocking a thread. Event loops can instead wait on the
+ * descriptor returned by notification_fd().
+ *
  * Copy constructor and copy assignment operations are restricted (deleted) for
  * the sake of simplicity and to avoid pointer problems.
  *
@@ -66,8 +215,119 @@ struct AcceessViolation : public std::exception {
  *
  * \date $Date: 2021/01/19 00:00:00 $
  */
-template <class T>
+template <class T, class Lock = AdaptiveMutex>
 class ThreadSafeList2D {
+  /// Removal version of a node that is still part of the list.
+  static constexpr uint64_t kAlive = UINT64_MAX;
+  /// Expiry time of a node pushed without a TTL.
+  static constexpr std::chrono::steady_clock::time_point kNever =
+      std::chrono::steady_clock::time_point::max();
+  /// Position of a removed node that was not counted, see unindex().
+  static constexpr size_t kNoPosition = SIZE_MAX;
+
+  /**
+   * \class SizeCounter
+   *
+   *
+   * \brief Element count, changed under the lock and read without it.
+   *
+   * Behaves like the size_t it replaces for the code holding the lock.
+   * Every change is also stored into an atomic on a cache line of its own,
+   * read by size() and empty(), unless the count is held: then only the
+   * final value is published, by release(). A second copy on another line
+   * is refreshed only when it drifts kSizeSlack away or the list becomes empty
+   * or non-empty, for size_relaxed().
+   *
+   *
+   * \author Liliya Makhmutova
+   *
+   * \version 1.0
+   *
+   * \date $Date: 2021/01/19 00:00:00 $
+   */
+  class SizeCounter {
+   public:
+    /// Holds the count for a scope, see hold().
+    class Hold {
+     public:
+      explicit Hold(SizeCounter& counter) noexcept : counter_(counter) {
+        counter_.hold();
+      }
+      Hold(const Hold& rhs) = delete;
+      Hold& operator=(const Hold& rhs) = delete;
+      ~Hold() { counter_.release(); }
+
+     private:
+      SizeCounter& counter_;
+    };
+
+    explicit SizeCounter(size_t value) noexcept
+        : value_(value), holds_(0), exact_(value), approximate_(value) {}
+
+    operator size_t() const noexcept { return value_; }
+
+    SizeCounter& operator=(size_t value) noexcept {
+      set(value);
+      return *this;
+    }
+    SizeCounter& operator+=(size_t count) noexcept {
+      set(value_ + count);
+      return *this;
+    }
+    size_t operator++(int) noexcept {
+      set(value_ + 1);
+      return value_ - 1;
+    }
+    size_t operator--(int) noexcept {
+      set(value_ - 1);
+      return value_ + 1;
+    }
+
+    /// Stops publishing changes until the matching release().
+    void hold() noexcept { ++holds_; }
+
+    /// Publishes the count once the last hold is released.
+    void release() noexcept {
+      if (--holds_ == 0) {
+        publish();
+      }
+    }
+
+    /// Published count, wait-free.
+    size_t load() const noexcept {
+      return exact_.load(std::memory_order_acquire);
+    }
+
+    /// Published count within kSizeSlack, wait-free.
+    size_t approximate() const noexcept {
+      return approximate_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    size_t value_;   /// the count seen under the lock
+    size_t holds_;   /// publishing is suspended while non-zero
+    alignas(64) std::atomic<size_t> exact_;
+    alignas(64) std::atomic<size_t> approximate_;  /// rarely written
+
+    void set(size_t value) noexcept {
+      value_ = value;
+      if (holds_ == 0) {
+        publish();
+      }
+    }
+
+    void publish() noexcept {
+      exact_.store(value_, std::memory_order_release);
+      size_t approximate = approximate_.load(std::memory_order_relaxed);
+      size_t drift = value_ > approximate ? value_ - approximate
+                                          : approximate - value_;
+      if (drift >= kSizeSlack ||
+          (drift > 0 && (value_ == 0 || approximate == 0))) {
+        approximate_.store(value_, std::memory_order_relaxed);
+      }
+    }
+  };
+
   /**
    * \struct Node
    *
@@ -76,7 +336,10 @@ class ThreadSafeList2D {
    *
    * \tparam T Class to store in the linked list.
    *
-   * Each node has pointer to previous and next node, it also stores a value.
+   * Each node has pointer to previous and next node, it also stores a value
+   * and the versions that inserted and removed it and a prefetch hint.
+   * next comes first, so a chain of nodes has the shape of the NodePool
+   * free list.
    *
    *
    * \author $Author: Liliya Makhmutova $
@@ -87,239 +350,3128 @@ class ThreadSafeList2D {
    */
   struct Node {
     explicit Node(T value, Node* prev)
-        : value(value), prev(prev), next(nullptr) {}
-    explicit Node(T value) : value(value), prev(nullptr), next(nullptr) {}
+        : next(nullptr),
+          prev(prev),
+          value(std::move(value)),
+          born(0),
+          died(kAlive),
+          jump(nullptr),
+          back_jump(nullptr) {}
+    explicit Node(T value)
+        : next(nullptr),
+          prev(nullptr),
+          value(std::move(value)),
+          born(0),
+          died(kAlive),
+          jump(nullptr),
+          back_jump(nullptr) {}
+    struct Node* next;
     struct Node* prev;
     T value;
-    struct Node* next;
+    uint64_t born;               /// version that linked the node
+    std::atomic<uint64_t> died;  /// version that removed it, read lock-free
+    std::atomic<Node*> jump;  /// node kJumpDistance steps ahead, a hint
+    std::atomic<Node*> back_jump;  /// node kJumpDistance steps back, a hint
   };
 
- public:
-  /// Simple constructor, initially list is empty
-  ThreadSafeList2D() noexcept : head(nullptr), tail(nullptr), size_(0) {}
-
-  /// Copy constructor is disabled
-  ThreadSafeList2D(const ThreadSafeList2D<T>& rhs) = delete;
-  /// Copy assignment is disabled
-  ThreadSafeList2D& operator=(const ThreadSafeList2D<T>& rhs) = delete;
+  /// Expiry time of a node pushed with a TTL, see expiry_.
+  struct Expiry {
+    std::chrono::steady_clock::time_point at;
+    uint64_t born;  /// born of the node it was set for
+  };
 
-  /// Recursively delete all the nodes in destructor
-  ~ThreadSafeList2D() {
-    Node* tmp = nullptr;
-    while (head) {
-      tmp = head;
-      head = head->next;
-      delete tmp;
-    }
-    head = nullptr;
-  }
+  /// Registered read view, see Snapshot.
+  struct SnapshotState {
+    uint64_t version;
+    size_t size;
+    Node* first;  /// physical range the view was taken from
+    Node* last;
+  };
 
-  /** \brief Method that returns the value of the first element of the linked
-   * list.
+ public:
+  /**
+   * \class Snapshot
    *
    *
-   * \return Outputs value of the first node.
+   * \brief Read view of the list at the version it was taken at.
    *
-   * \warning this finction uses mutex lock_guard and throws AcceessViolation
-   * exception in case of empty list.
-   */
-  T front() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!head) {
-      throw AcceessViolation();
-    }
-    return head->value;
-  }
-
-  /** \brief Method that returns the value of the last element of the linked
-   * list.
+   * The view is traversed without the list lock while other threads keep
+   * pushing and removing. Nodes removed after the snapshot was taken stay
+   * readable until the last snapshot that can see them is destroyed.
+   * A snapshot must not outlive its list.
    *
    *
-   * \return Outputs value of the last node.
+   * \author Liliya Makhmutova
    *
-   * \warning this finction uses mutex lock_guard and throws AcceessViolation
-   * exception in case of empty list.
+   * \version 1.0
+   *
+   * \date $Date: 2021/01/19 00:00:00 $
    */
-  T back() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!tail) {
-      throw AcceessViolation();
+  class Snapshot {
+   public:
+    Snapshot(Snapshot&& rhs) noexcept : list_(rhs.list_), state_(rhs.state_) {
+      rhs.list_ = nullptr;
     }
-    return tail->value;
-  }
+    Snapshot(const Snapshot& rhs) = delete;
+    Snapshot& operator=(const Snapshot& rhs) = delete;
+    Snapshot& operator=(Snapshot&& rhs) = delete;
 
-  /** \brief Method that returns the size of the linked list.
-   *
-   * \return Outputs actual size of list.
+    /// Releases the view and lets the list reclaim what only it could see.
+    ~Snapshot() {
+      if (list_) {
+        list_->release(state_);
+      }
+    }
+
+    /// Version of the list the view shows.
+    uint64_t version() const noexcept { return state_->version; }
+
+    /// Number of elements in the view.
+    size_t size() const noexcept { return state_->size; }
+
+    /** \brief Calls fn(const T&) for every element from head to tail.
+     *
+     * \note The list lock is taken only to start and to finish the walk.
+     */
+    template <class Fn>
+    void for_each(Fn&& fn) const {
+      list_->traverse(*state_, fn);
+    }
+
+    /// Copies the elements of the view into a vector.
+    std::vector<T> to_vector() const {
+      return copy_values(size(), [this](auto&& visit) { for_each(visit); });
+    }
+
+   private:
+    friend class ThreadSafeList2D;
+
+    Snapshot(ThreadSafeList2D* list,
+             typename std::list<SnapshotState>::iterator state) noexcept
+        : list_(list), state_(state) {}
+
+    ThreadSafeList2D* list_;
+    typename std::list<SnapshotState>::iterator state_;
+  };
+
+  /**
+   * \class Transaction
    *
-   * \warning this finction uses mutex lock_guard.
    *
-   * \note This method is guaranteed not to throw an exception.
-   */
-  size_t size() noexcept {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return size_;
-  }
-
-  /** \brief Method that returns true if list is empty.
+   * \brief Handle passed to the function run by transact().
    *
-   * It checks whether size == 0.
+   * Offers the usual list operations on a list whose lock is already held.
+   * Operations take effect immediately, so the transaction sees its own
+   * changes, but other threads see none of them until the function returns.
+   * If the function throws, all operations are undone in reverse order and
+   * the list is left exactly as it was (removed nodes are relinked at their
+   * old places). Records for an attached OpLog are emitted only on commit.
    *
-   * \return Boolean value that indicates that list is empty.
-   * \warning this finction uses mutex lock_guard.
-   * \note This method is guaranteed not to throw an exception.
-   */
-  bool empty() noexcept {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return size_ == 0;
-  }
-
-  /** \brief Method inserts element at the beginning.
-   * \param val value that will be added to the list
    *
-   * It creates new element with a value passed.
-   * Then updates head and links to the existing list.
+   * \author Liliya Makhmutova
    *
+   * \version 1.0
    *
-   * \warning this finction uses mutex lock_guard.
-   * \note This method is guaranteed not to throw an exception.
+   * \date $Date: 2021/01/19 00:00:00 $
    */
-  void push_front(T val) noexcept {
-    std::lock_guard<std::mutex> lock(mutex_);
+  class Transaction {
+   public:
+    Transaction(const Transaction& rhs) = delete;
+    Transaction& operator=(const Transaction& rhs) = delete;
 
-    Node* node = new Node(val);
-    Node* tmp = head;
-    if (head == nullptr) {  // empty list
-      head = tail = node;
-    } else {
-      node->next = head;
-      head = node;
-      node->next->prev = node;
+    /// Undoes the operations unless the transaction was committed.
+    ~Transaction() {
+      if (!committed_) {
+        rollback();
+        list_.size_.release();
+      }
     }
-    size_++;
-  }
 
-  /** \brief Method inserts element at the end.
-   * \param val value that will be added to the list
-   *
-   * It creates new element with a value passed.
-   * Then updates tail and links to the existing list.
-   *
-   *
-   * \warning this finction uses mutex lock_guard.
-   * \note This method is guaranteed not to throw an exception.
-   */
-  void push_back(T val) noexcept {
-    std::lock_guard<std::mutex> lock(mutex_);
+    /// Value of the first element, throws AcceessViolation if empty.
+    /// Expired elements at the front are removed first, as the list does.
+    const T& front() {
+      drop_expired(true);
+      Node* node = first_alive(list_.head);
+      if (!node) {
+        throw AcceessViolation();
+      }
+      return node->value;
+    }
 
-    Node* node = new Node(val, tail);
-    if (head == nullptr) {  // empty list
-      head = tail = node;
-    } else {
-      tail->next = node;
-      tail = node;
+    /// Value of the last element, throws AcceessViolation if empty.
+    /// Expired elements at the back are removed first, as the list does.
+    const T& back() {
+      drop_expired(false);
+      Node* node = last_alive(list_.tail);
+      if (!node) {
+        throw AcceessViolation();
+      }
+      return node->value;
     }
-    size_++;
-  }
 
-  /** \brief Method removes element from the list by value.
-   * \param val value that will be removed
-   *
-   * It searches the node with value val. Then depending on where the node is
-   * located, it frees memory and fixes list structure.
-   *
-   *
-   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
-   */
-  void remove(T val) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    /// Size of the list including the effects of this transaction.
+    size_t size() const noexcept { return list_.size_; }
 
-    Node* found_node = find(val);
-    Node* tmp = head;
+    /// Returns true if the list is empty.
+    bool empty() const noexcept { return list_.size_ == 0; }
 
-    if (found_node) {  // nothing to delete otherwise
-      if (found_node == head) {
-        head = head->next;
-        if (head) {
-          head->prev = nullptr;
-        } else {
-          tail = nullptr;
-        }
-        delete found_node;
-      } else if (found_node == tail) {
-        tail = tail->prev;
-        if (tail) {
-          tail->next = nullptr;
-        }
-        delete found_node;
-      } else {
-        Node* prev_node = found_node->prev;
-        Node* next_node = found_node->next;
-        prev_node->next = next_node;
-        next_node->prev = prev_node;
-        delete found_node;
+    /// Inserts element at the beginning, it expires as set by set_ttl().
+    void push_front(T val) {
+      Node* node = create_node(std::move(val));
+      Expiry* expiry = prepare_push(node);
+      list_.link_front(node);
+      entries_.push_back(
+          Entry{ListOp::PushFront, node, nullptr, nullptr, 0});
+      if (expiry) {
+        expiry->born = node->born;
       }
-      size_--;
-    } else {
-      throw ElementNotFound();
     }
-  }
 
-#ifdef TESTING_MODE
-  /// Need to iterate forward the list and get vector of list values (for
-  /// testing purposes only).
-  std::vector<T> get_fwd() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<T> result;
-    Node* node = head;
+    /// Inserts element at the end, it expires as set by set_ttl().
+    void push_back(T val) {
+      Node* node = create_node(std::move(val));
+      Expiry* expiry = prepare_push(node);
+      list_.link_back(node);
+      entries_.push_back(
+          Entry{ListOp::PushBack, node, nullptr, nullptr, 0});
+      if (expiry) {
+        expiry->born = node->born;
+      }
+    }
 
-    while (node != nullptr) {
-      result.push_back(node->value);
-      node = node->next;
+    /// Removes element by value, throws ElementNotFound.
+    void remove(const T& val) {
+      size_t position = kNoPosition;
+      Node* node = list_.find(val, list_.indexed_ ? &position : nullptr);
+      if (!node) {
+        throw ElementNotFound();
+      }
+      erase(node, ListOp::Remove, position);
     }
 
-    return result;
-  }
+    /// Removes the first element, throws AcceessViolation if empty.
+    T pop_front() {
+      drop_expired(true);
+      Node* node = first_alive(list_.head);
+      if (!node) {
+        throw AcceessViolation();
+      }
+      T value = node->value;
+      erase(node, ListOp::PopFront, 0);
+      return value;
+    }
 
-  /// Need to iterate backward the list and get vector of list values (for
-  /// testing purposes only).
-  std::vector<T> get_bwd() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<T> result;
-    Node* node = tail;
+    /// Removes the last element, throws AcceessViolation if empty.
+    T pop_back() {
+      drop_expired(false);
+      Node* node = last_alive(list_.tail);
+      if (!node) {
+        throw AcceessViolation();
+      }
+      T value = node->value;
+      erase(node, ListOp::PopBack, list_.size_ - 1);
+      return value;
+    }
 
-    while (node != nullptr) {
-      result.push_back(node->value);
-      node = node->prev;
+   private:
+    friend class ThreadSafeList2D;
+
+    /// Undo information of a single operation.
+    struct Entry {
+      ListOp op;
+      Node* node;
+      Node* prev;  /// neighbours of a removed node
+      Node* next;
+      size_t position;  /// of a removed node, if the index is built
+    };
+
+    explicit Transaction(ThreadSafeList2D& list)
+        : list_(list), detached_(list.snapshots_.empty()), committed_(false) {
+      list_.size_.hold();  // size() shows the result only, see SizeCounter
     }
 
-    return result;
-  }
-#endif
+    ThreadSafeList2D& list_;
+    const bool detached_;  /// removed nodes are unlinked, not stamped
+    bool committed_;
+    std::vector<Entry> entries_;
 
- private:
-  Node* head;
-  Node* tail;
-  size_t size_;
-  mutable std::mutex mutex_;  /// to use std::lock_guard
+    /// Makes room for one more entry, so that push_back() of the entry
+    /// cannot throw after the list was changed. Grows geometrically.
+    void reserve_entry() {
+      if (entries_.size() == entries_.capacity()) {
+        entries_.reserve(std::max<size_t>(2 * entries_.capacity(), 8));
+      }
+    }
 
-  /** \brief Method that finds element in the list by value.
-   * \param val value that will be found
-   *
-   * It searches the node with value val iterating the list forward.
-   *
-   * \return pointer to the found node.
-   *
-   * \note This method is guaranteed not to throw an exception.
-   */
-  Node* find(T val) noexcept {
-    Node* node = head;
-    while (node != nullptr) {
-      if (node->value == val) {
-        return node;
+    /// Makes room for the entry of a pushed node and adds its expiry entry
+    /// (see add_expiry()); the node is destroyed if either fails. The entry
+    /// of a node undone by rollback() lingers until the next sweep.
+    Expiry* prepare_push(Node* node) {
+      try {
+        reserve_entry();
+        return list_.add_expiry(node, list_.ttl_);
+      } catch (...) {
+        destroy_node(node);
+        throw;
       }
-      node = node->next;
     }
-    return nullptr;
+
+    void erase(Node* node, ListOp op, size_t position) {
+      reserve_entry();
+      Entry entry{op, node, node->prev, node->next, position};
+      if (detached_) {
+        list_.unindex(node, position);
+        list_.unlink(node);  // freed on commit, relinked on rollback
+        list_.size_--;
+      } else {
+        list_.retire(node, position);
+      }
+      entries_.push_back(entry);
+    }
+
+    /// Removes the expired elements at one end as pops, undone on rollback.
+    void drop_expired(bool from_front) {
+      if (!list_.expiring_) {
+        return;
+      }
+      const std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      for (;;) {
+        Node* node =
+            from_front ? first_alive(list_.head) : last_alive(list_.tail);
+        if (!node || list_.expires_at(node) > now) {
+          return;
+        }
+        erase(node, from_front ? ListOp::PopFront : ListOp::PopBack,
+              from_front ? 0 : list_.size_ - 1);
+      }
+    }
+
+    void commit() {
+      committed_ = true;
+      list_.size_.release();  // the lock may be gone before the destructor
+      for (const Entry& entry : entries_) {
+        list_.record(entry.op, entry.node->value);
+      }
+      if (detached_) {
+        for (const Entry& entry : entries_) {
+          if (entry.op != ListOp::PushFront && entry.op != ListOp::PushBack) {
+            destroy_node(entry.node);
+          }
+        }
+      }
+    }
+
+    void rollback() noexcept {
+      for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        Node* node = it->node;
+        if (it->op == ListOp::PushFront || it->op == ListOp::PushBack) {
+          list_.unindex(node);  // back at the end it was pushed to
+          list_.unlink(node);
+          list_.size_--;
+          destroy_node(node);
+        } else if (detached_) {
+          node->prev = it->prev;
+          node->next = it->next;
+          if (it->prev) {
+            it->prev->next = node;
+          } else {
+            list_.head = node;
+          }
+          if (it->next) {
+            it->next->prev = node;
+          } else {
+            list_.tail = node;
+          }
+          list_.size_++;
+          list_.index_at(node, it->position);
+        } else {
+          // the node is the latest graveyard entry that is still pending
+          auto grave = std::find(list_.graveyard_.rbegin(),
+                                 list_.graveyard_.rend(), node);
+          list_.graveyard_.erase(std::next(grave).base());
+          node->died.store(kAlive, std::memory_order_relaxed);
+          list_.size_++;
+          list_.index_at(node, it->position);
+        }
+      }
+    }
+  };
+
+ public:
+#ifdef THREAD_SAFE_LIST_COROUTINES
+  /// Schedules a resumed coroutine, e.g. posts it to an executor queue.
+  using Executor = std::function<void(std::coroutine_handle<>)>;
+
+  /**
+   * \class PopAwaiter
+   *
+   *
+   * \brief Awaitable returned by async_pop_front().
+   *
+   * Completes immediately if the list has an element. Otherwise the
+   * coroutine is queued (first come, first served) and suspended without
+   * blocking its thread; the next push hands its element directly to the
+   * oldest waiter and resumes it after the list lock is released, either
+   * inline on the pushing thread or through the executor. Destroying a
+   * suspended coroutine removes it from the queue.
+   *
+   *
+   * \author Liliya Makhmutova
+   *
+   * \version 1.0
+   *
+   * \date $Date: 2021/01/19 00:00:00 $
+   */
+  class PopAwaiter {
+   public:
+    PopAwaiter(const PopAwaiter& rhs) = delete;
+    PopAwaiter& operator=(const PopAwaiter& rhs) = delete;
+
+    ~PopAwaiter() {
+      std::lock_guard<Lock> lock(list_->mutex_);
+      if (queued_) {
+        list_->cancel_waiter(this);
+      }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    /// Takes an element right away or queues the coroutine.
+    bool await_suspend(std::coroutine_handle<> handle) {
+      std::lock_guard<Lock> lock(list_->mutex_);
+      Node* node = list_->pop_candidate(true);
+      if (node) {
+        value_.emplace(list_->take(node, ListOp::PopFront));
+        list_->note_removal();
+        return false;
+      }
+      handle_ = handle;
+      queued_ = true;
+      if (list_->waiters_tail_) {
+        list_->waiters_tail_->next_ = this;
+      } else {
+        list_->waiters_head_ = this;
+      }
+      list_->waiters_tail_ = this;
+      return true;
+    }
+
+    /// Returns the popped element.
+    T await_resume() { return std::move(*value_); }
+
+   private:
+    friend class ThreadSafeList2D;
+
+    PopAwaiter(ThreadSafeList2D* list, Executor executor)
+        : list_(list), executor_(std::move(executor)) {}
+
+    ThreadSafeList2D* list_;
+    Executor executor_;
+    std::coroutine_handle<> handle_;
+    std::optional<T> value_;
+    PopAwaiter* next_ = nullptr;  /// next waiter in the queue
+    bool queued_ = false;         /// guarded by the list lock
+
+    void dispatch() {
+      if (executor_) {
+        executor_(handle_);
+      } else {
+        handle_.resume();
+      }
+    }
+  };
+#endif
+
+  /**
+   * \class Producer
+   *
+   *
+   * \brief Buffered push handle returned by make_producer().
+   *
+   * push_back() only appends to a private chain of nodes. The chain is
+   * spliced to the end of the list with a single lock acquisition once it
+   * holds max_batch elements or its oldest element is older than
+   * max_delay, and on flush() or destruction. Until then the elements are
+   * invisible to the list. The delay is only checked on push, so a
+   * producer that goes idle should call flush().
+   *
+   * A handle is meant to be used by one thread; give every producer thread
+   * its own.
+   *
+   *
+   * \author Liliya Makhmutova
+   *
+   * \version 1.0
+   *
+   * \date $Date: 2021/01/19 00:00:00 $
+   */
+  class Producer {
+   public:
+    Producer(const Producer& rhs) = delete;
+    Producer& operator=(const Producer& rhs) = delete;
+
+    Producer(Producer&& rhs) noexcept
+        : list_(rhs.list_),
+          max_batch_(rhs.max_batch_),
+          max_delay_(rhs.max_delay_),
+          first_(rhs.first_),
+          last_(rhs.last_),
+          count_(rhs.count_),
+          started_(rhs.started_) {
+      rhs.first_ = rhs.last_ = nullptr;
+      rhs.count_ = 0;
+    }
+
+    /// Publishes whatever is still buffered.
+    ~Producer() { flush(); }
+
+    /** \brief Method buffers element for the end of the list.
+     * \param val value that will be added to the list
+     *
+     * \note This method is guaranteed not to throw an exception.
+     */
+    void push_back(T val) noexcept {
+      Node* node = create_node(std::move(val));
+      if (last_) {
+        last_->next = node;
+        node->prev = last_;
+      } else {
+        first_ = node;
+        if (max_delay_.count() > 0) {
+          started_ = std::chrono::steady_clock::now();
+        }
+      }
+      last_ = node;
+      if (++count_ >= max_batch_ ||
+          (max_delay_.count() > 0 &&
+           std::chrono::steady_clock::now() - started_ >= max_delay_)) {
+        flush();
+      }
+    }
+
+    /** \brief Method splices the buffered elements into the list.
+     *
+     * \warning this function uses mutex lock_guard.
+     * \note This method is guaranteed not to throw an exception.
+     */
+    void flush() noexcept {
+      if (!first_) {
+        return;
+      }
+      list_->splice_back(first_, last_, count_);
+      first_ = last_ = nullptr;
+      count_ = 0;
+    }
+
+    /// Number of buffered elements not yet in the list.
+    size_t pending() const noexcept { return count_; }
+
+   private:
+    friend class ThreadSafeList2D;
+
+    Producer(ThreadSafeList2D* list, size_t max_batch,
+             std::chrono::nanoseconds max_delay) noexcept
+        : list_(list),
+          max_batch_(max_batch ? max_batch : 1),
+          max_delay_(max_delay),
+          first_(nullptr),
+          last_(nullptr),
+          count_(0) {}
+
+    ThreadSafeList2D* list_;
+    size_t max_batch_;
+    std::chrono::nanoseconds max_delay_;  /// zero disables the time limit
+    Node* first_;  /// private chain, not linked to the list yet
+    Node* last_;
+    size_t count_;
+    std::chrono::steady_clock::time_point started_;  /// first buffered push
+  };
+
+  /// Simple constructor, initially list is empty
+  ThreadSafeList2D() noexcept
+      : head(nullptr),
+        tail(nullptr),
+        size_(0),
+        log_(nullptr),
+        version_(0),
+        traversals_(0),
+        relinkers_(0),
+        collect_at_(kCollectBatch),
+        waiters_head_(nullptr),
+        waiters_tail_(nullptr),
+        watermark_(0),
+        compact_after_(0),
+        removals_(0),
+        indexed_(false),
+        ttl_(0),
+        expiring_(false),
+        recent_front_(),
+        recent_back_(),
+        front_links_(0),
+        back_links_(0) {}
+
+  /** \brief Constructor that copies the elements of [first, last).
+   *
+   * The chain is built before the list is shared, so no lock is taken.
+   * For forward iterators the nodes come from contiguous NodePool slabs.
+   */
+  template <class InputIt,
+            class = typename std::iterator_traits<InputIt>::iterator_category>
+  ThreadSafeList2D(InputIt first, InputIt last) : ThreadSafeList2D() {
+    adopt(build_chain(first, last));
+  }
+
+  /// Constructor that copies the elements of a range (anything with
+  /// std::begin and std::end), see the iterator constructor.
+  template <class Range,
+            class = decltype(std::begin(std::declval<const Range&>()))>
+  explicit ThreadSafeList2D(const Range& range)
+      : ThreadSafeList2D(std::begin(range), std::end(range)) {}
+
+  /// Constructor from a braced list of values.
+  ThreadSafeList2D(std::initializer_list<T> values)
+      : ThreadSafeList2D(values.begin(), values.end()) {}
+
+  /// Copy constructor is disabled
+  ThreadSafeList2D(const ThreadSafeList2D& rhs) = delete;
+  /// Copy assignment is disabled
+  ThreadSafeList2D& operator=(const ThreadSafeList2D& rhs) = delete;
+
+  /// Recursively delete all the nodes in destructor
+  ~ThreadSafeList2D() {
+    destroy_chain(head, tail);
+    head = nullptr;
+  }
+
+  /** \brief Method replaces the contents with the elements of [first, last).
+   *
+   * The new chain is built and the old one destroyed outside the lock; the
+   * swap itself is one atomic step. Attached logs see the old elements
+   * popped and the new ones pushed.
+   *
+   *
+   * \warning this finction uses mutex lock_guard.
+   */
+  template <class InputIt,
+            class = typename std::iterator_traits<InputIt>::iterator_category>
+  void assign(InputIt first, InputIt last) {
+    Chain chain = build_chain(first, last);
+    Node* old_head = nullptr;
+    Node* old_tail = nullptr;
+    Wakeup wakeup;
+    {
+      std::lock_guard<Lock> lock(mutex_);
+      typename SizeCounter::Hold hold(size_);  // size() never shows 0
+      drop_index();
+      if (snapshots_.empty()) {
+        for (Node* node = head; node != nullptr; node = node->next) {
+          record(ListOp::PopFront, node->value);
+        }
+        old_head = head;
+        old_tail = tail;
+        head = tail = nullptr;
+        size_ = 0;
+        forget_recent();
+        expiry_.clear();
+      } else {
+        // Snapshots may still read the old nodes, retire them one by one.
+        for (Node* node = head; node != nullptr; node = node->next) {
+          if (is_alive(node)) {
+            record(ListOp::PopFront, node->value);
+            retire(node);
+          }
+        }
+      }
+      if (chain.first) {
+        append_chain(chain);
+      }
+      wakeup = wakeups(0);
+    }
+    wake(wakeup);
+    destroy_chain(old_head, old_tail);
+  }
+
+  /// Same as assign(first, last) for a range.
+  template <class Range,
+            class = decltype(std::begin(std::declval<const Range&>()))>
+  void assign(const Range& range) {
+    assign(std::begin(range), std::end(range));
+  }
+
+  /// Same as assign(first, last) for a braced list of values.
+  void assign(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+  }
+
+  /** \brief Method that returns the value of the first element of the linked
+   * list.
+   *
+   *
+   * \return Outputs value of the first node.
+   *
+   * \warning this finction uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T front() {
+    std::lock_guard<Lock> lock(mutex_);
+    drop_expired(true);
+    Node* node = first_alive(head);
+    if (!node) {
+      throw AcceessViolation();
+    }
+    return node->value;
+  }
+
+  /** \brief Method that returns the value of the last element of the linked
+   * list.
+   *
+   *
+   * \return Outputs value of the last node.
+   *
+   * \warning this finction uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T back() {
+    std::lock_guard<Lock> lock(mutex_);
+    drop_expired(false);
+    Node* node = last_alive(tail);
+    if (!node) {
+      throw AcceessViolation();
+    }
+    return node->value;
+  }
+
+  /** \brief Method that returns the size of the linked list.
+   *
+   * Wait-free: the size is published to an atomic after every change, so
+   * no lock is taken. A concurrent operation may or may not be counted;
+   * intermediate sizes of transactions and assign() are never shown.
+   *
+   * \return Outputs actual size of list.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  size_t size() const noexcept { return size_.load(); }
+
+  /** \brief Method that returns true if list is empty.
+   *
+   * It checks whether size == 0, wait-free like size().
+   *
+   * \return Boolean value that indicates that list is empty.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  bool empty() const noexcept { return size_.load() == 0; }
+
+  /// Largest difference between size_relaxed() and size().
+  static constexpr size_t kSizeSlack = 64;
+
+  /** \brief Method that returns the size, possibly slightly outdated.
+   *
+   * Reads a copy of the size that writers refresh only when it is off by
+   * kSizeSlack elements or the list became empty or non-empty.
+   * Readers polling it therefore share a cache line that is rarely
+   * written instead of pulling the live counter away from the writers on
+   * every change. Meant for load balancing over many lists.
+   *
+   * \return Outputs a value within kSizeSlack of the size, exact for empty
+   * lists.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  size_t size_relaxed() const noexcept { return size_.approximate(); }
+
+  /** \brief Method inserts element at the beginning.
+   * \param val value that will be added to the list
+   *
+   * It creates new element with a value passed.
+   * Then updates head and links to the existing list.
+   *
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void push_front(T val) noexcept {
+    push(create_node(std::move(val)), true, std::nullopt);
+  }
+
+  /** \brief Method inserts element at the beginning that expires after ttl.
+   * \param val value that will be added to the list
+   * \param ttl time to live, zero or less for no expiry; overrides set_ttl()
+   *
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void push_front_with_ttl(T val,
+                           std::chrono::steady_clock::duration ttl) noexcept {
+    push(create_node(std::move(val)), true, ttl);
+  }
+
+  /** \brief Method inserts element at the end.
+   * \param val value that will be added to the list
+   *
+   * It creates new element with a value passed.
+   * Then updates tail and links to the existing list.
+   *
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void push_back(T val) noexcept {
+    push(create_node(std::move(val)), false, std::nullopt);
+  }
+
+  /** \brief Method inserts element at the end that expires after ttl.
+   * \param val value that will be added to the list
+   * \param ttl time to live, zero or less for no expiry; overrides set_ttl()
+   *
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void push_back_with_ttl(T val,
+                          std::chrono::steady_clock::duration ttl) noexcept {
+    push(create_node(std::move(val)), false, ttl);
+  }
+
+  /** \brief Method removes element from the list by value.
+   * \param val value that will be removed
+   *
+   * It searches the node with value val. Then depending on where the node is
+   * located, it frees memory and fixes list structure.
+   *
+   *
+   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
+   */
+  void remove(const T& val) {
+    if (!remove_if_present(val)) {
+      throw ElementNotFound();
+    }
+  }
+
+  /** \brief Method removes element from the list by value if it is there.
+   * \param val value that will be removed
+   *
+   * Same as remove(), but a missing element is reported by the result
+   * rather than by an exception.
+   *
+   * \return Outputs false if no element is equal to val.
+   *
+   * \warning this finction uses mutex lock_guard.
+   */
+  bool remove_if_present(const T& val) {
+    std::lock_guard<Lock> lock(mutex_);
+    return remove_locked(val);
+  }
+
+  /** \brief Method removes the first element equal to a key.
+   * \param key value compared with the elements as element == key
+   *
+   * Like remove(), but the key can be of any type comparable with T, so
+   * no T has to be constructed for the lookup.
+   *
+   *
+   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
+   */
+  template <class K>
+  void remove_by_key(const K& key) {
+    remove_if_found([&key](const T& value) { return value == key; });
+  }
+
+  /** \brief Method removes the first element whose key equals key.
+   * \param key key to look for
+   * \param key_fn callable returning the key of an element, e.g. a member
+   * accessor; called as key_fn(const T&)
+   *
+   *
+   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
+   */
+  template <class K, class KeyFn>
+  void remove_by_key(const K& key, KeyFn key_fn) {
+    remove_if_found(
+        [&key, &key_fn](const T& value) { return key_fn(value) == key; });
+  }
+
+  /** \brief Method returns the first element equal to a key.
+   * \param key value compared with the elements as element == key
+   *
+   * \return Outputs copy of the found element.
+   *
+   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
+   */
+  template <class K>
+  T find_by(const K& key) {
+    return copy_if_found([&key](const T& value) { return value == key; });
+  }
+
+  /** \brief Method returns the first element whose key equals key.
+   * \param key key to look for
+   * \param key_fn callable returning the key of an element; called as
+   * key_fn(const T&) and may return a reference to avoid copies
+   *
+   * \return Outputs copy of the found element.
+   *
+   * \warning this finction uses mutex lock_guard and throws ElementNotFound.
+   */
+  template <class K, class KeyFn>
+  T find_by(const K& key, KeyFn key_fn) {
+    return copy_if_found(
+        [&key, &key_fn](const T& value) { return key_fn(value) == key; });
+  }
+
+  /** \brief Method removes the first element and returns its value.
+   *
+   *
+   * \return Outputs value of the removed node.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T pop_front() {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = pop_candidate(true);
+    if (!node) {
+      throw AcceessViolation();
+    }
+    T value = take(node, ListOp::PopFront);
+    note_removal();
+    return value;
+  }
+
+  /** \brief Method removes the last element and returns its value.
+   *
+   *
+   * \return Outputs value of the removed node.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception in case of empty list.
+   */
+  T pop_back() {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = pop_candidate(false);
+    if (!node) {
+      throw AcceessViolation();
+    }
+    T value = take(node, ListOp::PopBack);
+    note_removal();
+    return value;
+  }
+
+  /** \brief Method returns the value of the first element, if any.
+   *
+   * Same as front(), but an empty list gives an empty optional rather than
+   * an exception.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  std::optional<T> front_if_any() { return peek(true); }
+
+  /// Same as front_if_any() but returns the last element.
+  std::optional<T> back_if_any() { return peek(false); }
+
+  /** \brief Method removes the first element and returns its value, if any.
+   *
+   * Same as pop_front(), but an empty list gives an empty optional rather
+   * than an exception.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  std::optional<T> pop_front_if_any() { return pop_if_any(true); }
+
+  /// Same as pop_front_if_any() but removes the last element.
+  std::optional<T> pop_back_if_any() { return pop_if_any(false); }
+
+  /** \brief Method inserts element at the beginning unless the lock is
+   * taken.
+   * \param val value that will be added to the list, dropped on failure
+   *
+   * Never waits: if another thread holds the lock (e.g. during a long
+   * remove() scan), nothing is inserted.
+   *
+   * \return Outputs ListStatus::Ok or ListStatus::Busy.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  ListStatus try_push_front(T val) noexcept {
+    return try_push(create_node(std::move(val)), true, std::nullopt);
+  }
+
+  /// Same as try_push_front() but inserts at the end.
+  ListStatus try_push_back(T val) noexcept {
+    return try_push(create_node(std::move(val)), false, std::nullopt);
+  }
+
+  /** \brief Method removes element by value unless the lock is taken.
+   * \param val value that will be removed
+   *
+   * \return Outputs ListStatus::Ok, ListStatus::NotFound or
+   * ListStatus::Busy.
+   */
+  ListStatus try_remove(const T& val) {
+    return try_locked(std::nullopt, [this, &val](Wakeup&) {
+      return remove_locked(val) ? ListStatus::Ok : ListStatus::NotFound;
+    });
+  }
+
+  /** \brief Method removes the first element unless the lock is taken.
+   * \param out receives the value of the removed node
+   *
+   * \return Outputs ListStatus::Ok, ListStatus::Empty or ListStatus::Busy.
+   */
+  ListStatus try_pop_front(T& out) {
+    return try_pop(out, true, std::nullopt);
+  }
+
+  /// Same as try_pop_front() but removes the last element.
+  ListStatus try_pop_back(T& out) { return try_pop(out, false, std::nullopt); }
+
+  /** \brief Method inserts element at the beginning, waiting for the lock at
+   * most timeout.
+   * \param val value that will be added to the list, dropped on failure
+   * \param timeout longest time to wait for the lock
+   *
+   * Uses try_lock_until() of the lock type if it has one (e.g.
+   * std::timed_mutex), otherwise polls try_lock(), spinning briefly and
+   * then yielding.
+   *
+   * \return Outputs ListStatus::Ok or ListStatus::Timeout.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  ListStatus try_push_front_for(
+      T val, std::chrono::steady_clock::duration timeout) noexcept {
+    return try_push(create_node(std::move(val)), true, deadline_in(timeout));
+  }
+
+  /// Same as try_push_front_for() but inserts at the end.
+  ListStatus try_push_back_for(
+      T val, std::chrono::steady_clock::duration timeout) noexcept {
+    return try_push(create_node(std::move(val)), false, deadline_in(timeout));
+  }
+
+  /// Same as try_remove() but waits for the lock at most timeout, see
+  /// try_push_front_for(); ListStatus::Timeout if it could not be taken.
+  ListStatus try_remove_for(const T& val,
+                            std::chrono::steady_clock::duration timeout) {
+    return try_locked(deadline_in(timeout), [this, &val](Wakeup&) {
+      return remove_locked(val) ? ListStatus::Ok : ListStatus::NotFound;
+    });
+  }
+
+  /// Same as try_pop_front() but waits for the lock at most timeout, see
+  /// try_push_front_for(); ListStatus::Timeout if it could not be taken.
+  ListStatus try_pop_front_for(T& out,
+                               std::chrono::steady_clock::duration timeout) {
+    return try_pop(out, true, deadline_in(timeout));
+  }
+
+  /// Same as try_pop_front_for() but removes the last element.
+  ListStatus try_pop_back_for(T& out,
+                              std::chrono::steady_clock::duration timeout) {
+    return try_pop(out, false, deadline_in(timeout));
+  }
+
+  /** \brief Method returns the value of the element at a position.
+   * \param position zero-based index from the head
+   *
+   * Positions are resolved through an index of the nodes in blocks of
+   * PositionIndex::kBlock, so the lookup is O(log n) rather than a walk
+   * from the head. The index is built on the first positional call (O(n))
+   * and then kept up to date by every change: removals by value or key
+   * count the position on their walk to the node, transactions update it
+   * per operation (and undo that on rollback), and compaction rebuilds it
+   * in its own O(n) pass. Only assign() drops it until the next positional
+   * call.
+   *
+   * \return Outputs value of the node.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception if position >= size.
+   */
+  T at(size_t position) {
+    std::lock_guard<Lock> lock(mutex_);
+    return indexed_node(position)->value;
+  }
+
+  /** \brief Method inserts element so that it ends up at a position.
+   * \param position zero-based index, size() appends to the end
+   * \param val value that will be added to the list
+   *
+   * Takes O(log n + PositionIndex::kBlock), see at(). Linking inside the
+   * list rewrites pointers that snapshot walks read without the lock, so an
+   * insertion away from the ends waits until the walks in progress are
+   * done; walks that start meanwhile wait for the insertion. The position
+   * is checked again after waiting, as the list may have changed.
+   *
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception if position > size. It must not be called from a walk of a
+   * snapshot of the same list.
+   */
+  void insert_at(size_t position, T val) {
+    Node* node = create_node(std::move(val));
+    Wakeup wakeup;
+    {
+      std::unique_lock<Lock> lock(mutex_);
+      Node* next = nullptr;
+      Expiry* expiry = nullptr;
+      try {
+        if (position > 0 && position < size_ && traversals_ > 0) {
+          wait_for_traversals(lock);
+        }
+        if (position > size_) {
+          throw AcceessViolation();
+        }
+        if (position > 0 && position < size_) {
+          next = indexed_node(position);
+        }
+        trim_expiry();
+        expiry = add_expiry(node, ttl_);
+      } catch (...) {
+        destroy_node(node);
+        throw;
+      }
+
+      size_t before = size_;
+      if (next) {
+        link_before(next, node, position);
+      } else if (position == 0) {
+        link_front(node);
+      } else {
+        link_back(node);
+      }
+      if (expiry) {
+        expiry->born = node->born;
+      }
+      record(ListOp::InsertAt, node->value, position);
+      wakeup = wakeups(before);
+    }
+    wake(wakeup);
+  }
+
+  /** \brief Method removes the element at a position and returns its value.
+   * \param position zero-based index from the head
+   *
+   * Takes O(log n + PositionIndex::kBlock), see at().
+   *
+   * \return Outputs value of the removed node.
+   *
+   * \warning this function uses mutex lock_guard and throws AcceessViolation
+   * exception if position >= size.
+   */
+  T erase_at(size_t position) {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = indexed_node(position);
+    index_.erase(position);
+    indexed_ = false;  // already up to date, keep retire() off the index
+    try {
+      T value = take(node, ListOp::EraseAt, position);
+      indexed_ = true;
+      note_removal();
+      return value;
+    } catch (...) {
+      drop_index();  // the node is still there, the index says otherwise
+      throw;
+    }
+  }
+
+  /** \brief Method sets the time to live of elements added from now on.
+   * \param ttl time to live, zero to add elements that never expire
+   *
+   * Applies to every way of adding elements except the _with_ttl pushes:
+   * push_front(), push_back() and their try_ and _for variants, the pushes
+   * of a Transaction, insert_at(), Producer batches (from their publication),
+   * load() and assign(). An element expires ttl after it was added.
+   *
+   * Expired elements are not timed individually: front(), back(), the pops
+   * and the moves to another list, also those of a Transaction, first
+   * remove the expired elements at their end of the list, and expire()
+   * removes them from the head in a batch. Until then they are still
+   * counted by size() and seen by the other methods. Removals are logged as
+   * pops from that end.
+   *
+   * \warning this function uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void set_ttl(std::chrono::steady_clock::duration ttl) noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    ttl_ = ttl;
+  }
+
+  /** \brief Method removes expired elements, walking from the head.
+   * \param now time to compare the expiry times with
+   *
+   * The walk stops at the first element that has not expired, so it costs
+   * O(expired) when the head holds the oldest elements, i.e. elements are
+   * pushed to the back with one TTL. An element with a longer TTL keeps
+   * the expired ones behind it until it expires itself.
+   *
+   * \return Outputs number of removed elements.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  size_t expire(std::chrono::steady_clock::time_point now =
+                    std::chrono::steady_clock::now()) {
+    std::lock_guard<Lock> lock(mutex_);
+    return expiring_ ? drop_expired(true, now) : 0;
+  }
+
+  /** \brief Method moves all nodes into contiguous slabs in list order.
+   *
+   * After many pushes and removals nodes are scattered over the heap and
+   * every step of a scan is a cache miss. Compaction relocates the values
+   * (moving them if that cannot throw, copying otherwise) so that forward
+   * and backward scans walk memory sequentially. It takes O(n) under the
+   * lock. If a copy throws, the list is left unchanged. The old nodes go
+   * back to the pool, and each slab of an earlier compaction is released
+   * with its last node, so repeated compaction does not grow memory.
+   *
+   * \return Outputs false if nothing was done because snapshots are alive
+   * (their lock-free readers may hold node pointers).
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  bool compact() {
+    std::lock_guard<Lock> lock(mutex_);
+    return compact_locked();
+  }
+
+  /** \brief Method enables automatic compaction.
+   * \param removals number of removals (remove, pop and their key
+   * variants) after which the list is compacted, 0 to disable
+   *
+   * Compaction then runs inside the removal that reaches the threshold,
+   * unless snapshots are alive; a failed compaction is skipped silently.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  void set_auto_compact(size_t removals) {
+    std::lock_guard<Lock> lock(mutex_);
+    compact_after_ = removals;
+    removals_ = 0;
+  }
+
+  /** \brief Method returns a buffered push handle.
+   * \param max_batch number of buffered elements that triggers a publish
+   * \param max_delay age of the oldest buffered element that triggers a
+   * publish, zero to publish by size only
+   *
+   * Pushing through the handle takes the list lock once per batch instead
+   * of once per element, at the price of delayed visibility.
+   *
+   * \return Outputs the handle, see Producer.
+   *
+   * \warning the list must outlive the handle.
+   */
+  Producer make_producer(
+      size_t max_batch = kProducerBatch,
+      std::chrono::nanoseconds max_delay = std::chrono::milliseconds(1)) {
+    return Producer(this, max_batch, max_delay);
+  }
+
+  /** \brief Method returns the lock guarding the list.
+   *
+   * Gives access to lock tuning and statistics, e.g. set_spin_budget() and
+   * stats() of AdaptiveMutex. Holding the lock blocks every other operation
+   * on the list.
+   *
+   * \return Outputs reference to the lock.
+   */
+  Lock& native_lock() const noexcept { return mutex_; }
+
+  /** \brief Method returns a descriptor that signals new elements.
+   * \param watermark if non-zero, the descriptor is also signalled when the
+   * size grows above it
+   *
+   * The descriptor (an eventfd on Linux, a pipe elsewhere) becomes readable
+   * when the list goes from empty to non-empty, so an event loop can wait
+   * in epoll_wait/poll instead of spinning on empty(). Elements handed
+   * straight to async_pop_front() waiters do not count. Consumers call
+   * acknowledge_notification() first and then pop until the list is
+   * empty. The descriptor is created on the first call and owned by the
+   * list; later calls only update the watermark.
+   *
+   * \return Outputs the descriptor to wait on for readability.
+   *
+   * \warning this function uses mutex lock_guard and throws NotifierError if
+   * the descriptor cannot be created.
+   */
+  int notification_fd(size_t watermark = 0) {
+    std::lock_guard<Lock> lock(mutex_);
+    if (!notifier_) {
+      notifier_.reset(new EventNotifier());
+    }
+    watermark_ = watermark;
+    return notifier_->fd();
+  }
+
+  /** \brief Method makes the notification descriptor non-readable again.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void acknowledge_notification() noexcept {
+    EventNotifier* notifier;
+    {
+      std::lock_guard<Lock> lock(mutex_);
+      notifier = notifier_.get();
+    }
+    if (notifier) {
+      notifier->acknowledge();
+    }
+  }
+
+#ifdef THREAD_SAFE_LIST_COROUTINES
+  /** \brief Method returns an awaitable that pops the first element.
+   * \param executor optional scheduler for the resumed coroutine; without it
+   * the coroutine is resumed on the thread that made an element available.
+   *
+   * co_await list.async_pop_front() yields the popped value. No thread is
+   * blocked while the list is empty.
+   *
+   * \return Outputs the awaitable, see PopAwaiter.
+   *
+   * \warning the list must outlive all coroutines waiting on it.
+   */
+  PopAwaiter async_pop_front(Executor executor = nullptr) {
+    return PopAwaiter(this, std::move(executor));
+  }
+#endif
+
+  /** \brief Method moves the first element to the end of another list.
+   * \param dst list that receives the element (may be this list)
+   *
+   * Both locks are held for the whole move, so the element is never missing
+   * from both lists or present in both. The node itself is relinked, no
+   * memory is freed or allocated, unless a snapshot of this list exists: the
+   * snapshot may still read the node, so then its value is copied into a new
+   * node instead.
+   *
+   *
+   * \warning this function locks both lists (in address order with
+   * MultiLock, so opposite moves between the same lists cannot deadlock)
+   * and throws AcceessViolation exception in case of empty source list.
+   */
+  void move_front_to_back(ThreadSafeList2D& dst) { move_to(dst, true, false); }
+
+  /// Same as move_front_to_back() but the element becomes dst's head.
+  void move_front_to_front(ThreadSafeList2D& dst) { move_to(dst, true, true); }
+
+  /// Same as move_front_to_back() but takes the last element.
+  void move_back_to_back(ThreadSafeList2D& dst) { move_to(dst, false, false); }
+
+  /// Same as move_front_to_back() but takes the last element and makes it
+  /// dst's head.
+  void move_back_to_front(ThreadSafeList2D& dst) { move_to(dst, false, true); }
+
+  /** \brief Method runs several operations as one atomic step.
+   * \param fn callable invoked as fn(Transaction&)
+   *
+   * The lock is taken once for the whole function, so other threads never
+   * observe an intermediate state (e.g. between pop_front and push_back of
+   * a rotation). If fn throws, every operation it made is undone before the
+   * exception propagates.
+   *
+   * \return Outputs whatever fn returns.
+   *
+   * \warning this function uses mutex lock_guard; fn must not call other
+   * methods of the same list directly.
+   */
+  template <class Fn>
+  auto transact(Fn&& fn) -> decltype(fn(std::declval<Transaction&>())) {
+    std::unique_lock<Lock> lock(mutex_);
+    size_t before = size_;
+    Transaction tx(*this);
+    if constexpr (std::is_void<decltype(fn(tx))>::value) {
+      fn(tx);
+      tx.commit();
+      Wakeup wakeup = wakeups(before);
+      lock.unlock();
+      wake(wakeup);
+    } else {
+      auto result = fn(tx);
+      tx.commit();
+      Wakeup wakeup = wakeups(before);
+      lock.unlock();
+      wake(wakeup);
+      return result;
+    }
+  }
+
+  /** \brief Method runs operations on this and other lists as one atomic
+   * step.
+   * \param fn callable invoked as fn(Transaction& this_tx, Transaction&
+   * other_tx...), one Transaction per list in argument order
+   * \param others lists that take part besides this one, all distinct
+   * from each other and from this one
+   *
+   * The locks of all lists are taken in address order (see MultiLock), so
+   * concurrent calls over the same lists in any order cannot deadlock.
+   * Nobody observes a state in which an element left one list and has not
+   * yet arrived at another. If fn throws, the operations are undone on
+   * every list.
+   *
+   * \return Outputs whatever fn returns.
+   *
+   * \warning this function locks the mutex of every list; fn must not call
+   * other methods of these lists directly. Throws std::invalid_argument,
+   * before anything is locked, if a list is passed twice.
+   */
+  template <class Fn, class... Others>
+  auto transact_with(Fn&& fn, Others&... others) {
+    static_assert((std::is_same<Others, ThreadSafeList2D>::value && ...),
+                  "every list must be of the same type");
+    constexpr size_t kCount = 1 + sizeof...(Others);
+    ThreadSafeList2D* lists[kCount] = {this, &others...};
+    for (size_t i = 0; i < kCount; ++i) {
+      for (size_t j = i + 1; j < kCount; ++j) {
+        if (lists[i] == lists[j]) {
+          throw std::invalid_argument("transact_with() got a list twice");
+        }
+      }
+    }
+    MultiLock<Lock, kCount> locks({&mutex_, &others.mutex_...});
+    size_t before[kCount] = {size_, others.size_...};
+    auto finish = [&] {
+      Wakeup wakeups[kCount];
+      for (size_t i = 0; i < kCount; ++i) {
+        wakeups[i] = lists[i]->wakeups(before[i]);
+      }
+      locks.unlock();
+      for (const Wakeup& wakeup : wakeups) {
+        wake(wakeup);
+      }
+    };
+    if constexpr (std::is_void<decltype(run_transactions<kCount>(
+                      fn, lists))>::value) {
+      run_transactions<kCount>(fn, lists);
+      finish();
+    } else {
+      auto result = run_transactions<kCount>(fn, lists);
+      finish();
+      return result;
+    }
+  }
+
+  /** \brief Method returns a read view of the current content.
+   *
+   * Taking a snapshot is O(1). While at least one snapshot exists, removals
+   * keep the removed nodes linked (stamped with the removing version) and
+   * they are reclaimed in batches once no remaining snapshot can see them.
+   *
+   * \return Outputs the view, see Snapshot.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  Snapshot snapshot() {
+    std::lock_guard<Lock> lock(mutex_);
+    snapshots_.push_back(SnapshotState{version_, size_, head, tail});
+    return Snapshot(this, std::prev(snapshots_.end()));
+  }
+
+  /** \brief Method starts (or stops) recording operations into a log.
+   * \param log operation log to append to, nullptr detaches the current one
+   *
+   * Every successful push_front, push_back, remove, pop_front, pop_back,
+   * insert_at and erase_at (including elements appended by load()) is
+   * appended to the log while the list lock is held, so records are in the
+   * order the operations took effect. remove_by_key() is recorded as
+   * erase_at of the removed position. The log must outlive the list or be
+   * detached first, and must not be attached to two lists at the same time.
+   *
+   *
+   * \warning this function uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  void attach_log(OpLog<T>* log) noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    log_ = log;
+  }
+
+  /** \brief Method applies all pending records of a log to this list.
+   * \param log operation log filled by another list
+   *
+   * Operations are replayed through the public methods in sequence order, so
+   * a replica that started as a copy of the source list follows it
+   * incrementally.
+   *
+   * \return Outputs number of applied records.
+   *
+   * \warning throws LogOverflow if records were dropped by the producer; the
+   * replica is out of sync then and has to be rebuilt from a snapshot.
+   * Exceptions of remove/pop (e.g. ElementNotFound) mean the replica had
+   * diverged from the source before.
+   */
+  size_t replay(OpLog<T>& log) {
+    uint64_t expected = log.consumed_sequence() + 1;
+    return log.drain([this, &expected](const OpRecord<T>& entry) {
+      if (entry.sequence != expected) {
+        throw LogOverflow();
+      }
+      ++expected;
+      switch (entry.op) {
+        case ListOp::PushFront:
+          push_front(entry.value);
+          break;
+        case ListOp::PushBack:
+          push_back(entry.value);
+          break;
+        case ListOp::Remove:
+          remove(entry.value);
+          break;
+        case ListOp::PopFront:
+          pop_front();
+          break;
+        case ListOp::PopBack:
+          pop_back();
+          break;
+        case ListOp::InsertAt:
+          insert_at(static_cast<size_t>(entry.position), entry.value);
+          break;
+        case ListOp::EraseAt:
+          erase_at(static_cast<size_t>(entry.position));
+          break;
+      }
+    });
+  }
+
+  /** \brief Method writes a binary snapshot of the list to a stream.
+   * \param out stream that receives the snapshot
+   * \param serializer object that encodes single elements
+   *
+   * The snapshot is a small header with the element count followed by the
+   * elements from head to tail. With the default TrivialSerializer elements
+   * are stored as raw fixed-size records, otherwise each encoded element is
+   * prefixed with its 32-bit length. Data is written in chunks of kIoChunk
+   * bytes.
+   *
+   *
+   * \warning this function uses mutex lock_guard for the whole write and
+   * throws SerializationError if the stream fails.
+   */
+  template <class Serializer = TrivialSerializer<T>>
+  void save(std::ostream& out, const Serializer& serializer = Serializer()) {
+    save_with(serializer, [&out](const char* data, size_t size) {
+      if (!out.write(data, static_cast<std::streamsize>(size))) {
+        throw SerializationError();
+      }
+    });
+  }
+
+  /** \brief Method writes a binary snapshot of the list to a file descriptor.
+   * \param fd open file descriptor that receives the snapshot
+   * \param serializer object that encodes single elements
+   *
+   * Same format as save(std::ostream&).
+   *
+   *
+   * \warning this function uses mutex lock_guard for the whole write and
+   * throws SerializationError if writing fails.
+   */
+  template <class Serializer = TrivialSerializer<T>>
+  void save(int fd, const Serializer& serializer = Serializer()) {
+    save_with(serializer, [fd](const char* data, size_t size) {
+      write_fd(fd, data, size);
+    });
+  }
+
+  /** \brief Method appends elements of a binary snapshot to the list.
+   * \param in stream positioned at the beginning of a snapshot
+   * \param serializer object that decodes single elements
+   *
+   * The whole chain is decoded into contiguous slabs of nodes without
+   * holding the lock, then it is spliced after the current tail in a single
+   * locked step. The element count of the header is checked against the
+   * bytes left in the stream before anything is allocated; if the stream
+   * cannot seek, a forged count still fails on the missing records rather
+   * than on a huge allocation, as nodes are allocated NodePool::kSlab at a
+   * time.
+   *
+   *
+   * \warning this function throws SerializationError on malformed or
+   * truncated input, the list is left unchanged in that case.
+   */
+  template <class Serializer = TrivialSerializer<T>>
+  void load(std::istream& in, const Serializer& serializer = Serializer()) {
+    load_with(
+        serializer,
+        [&in](char* data, size_t size) {
+          if (!in.read(data, static_cast<std::streamsize>(size))) {
+            throw SerializationError();
+          }
+        },
+        remaining_bytes(in));
+  }
+
+  /** \brief Method appends elements of a binary snapshot to the list.
+   * \param fd open file descriptor positioned at the beginning of a snapshot
+   * \param serializer object that decodes single elements
+   *
+   * Same as load(std::istream&).
+   *
+   *
+   * \warning this function throws SerializationError on malformed or
+   * truncated input, the list is left unchanged in that case.
+   */
+  template <class Serializer = TrivialSerializer<T>>
+  void load(int fd, const Serializer& serializer = Serializer()) {
+    load_with(
+        serializer, [fd](char* data, size_t size) { read_fd(fd, data, size); },
+        remaining_bytes(fd));
+  }
+
+  /** \brief Method streams the list content to a sink in chunks.
+   * \param sink callable invoked as sink(const T* values, size_t count)
+   * \param chunk_size maximal number of values passed to one sink call
+   *
+   * The content is read from a snapshot, so writers keep going while the
+   * elements are collected and handed to the sink. Only one chunk of values
+   * is buffered at a time.
+   *
+   *
+   * \warning Exceptions thrown by the sink are propagated.
+   */
+  template <class Sink>
+  void export_chunks(Sink&& sink, size_t chunk_size = kExportChunk) {
+    if (chunk_size == 0) {
+      chunk_size = 1;
+    }
+    Snapshot view = snapshot();
+    std::vector<T> chunk;
+    if constexpr (kBitwiseCopy) {
+      chunk.resize(std::min(chunk_size, view.size()));
+      size_t filled = 0;
+      view.for_each([&](const T& value) {
+        std::memcpy(chunk.data() + filled, &value, sizeof(T));
+        if (++filled == chunk.size()) {
+          sink(static_cast<const T*>(chunk.data()), filled);
+          filled = 0;
+        }
+      });
+      if (filled != 0) {
+        sink(static_cast<const T*>(chunk.data()), filled);
+      }
+    } else {
+      chunk.reserve(std::min(chunk_size, view.size()));
+      view.for_each([&](const T& value) {
+        chunk.push_back(value);
+        if (chunk.size() == chunk_size) {
+          sink(static_cast<const T*>(chunk.data()), chunk.size());
+          chunk.clear();
+        }
+      });
+      if (!chunk.empty()) {
+        sink(static_cast<const T*>(chunk.data()), chunk.size());
+      }
+    }
+  }
+
+  /** \brief Method streams a snapshot of the list to a file descriptor.
+   * \param fd open file descriptor that receives the snapshot
+   * \param serializer object that encodes single elements
+   *
+   * Writes the same format as save(), so the result can be read back with
+   * load(), but like export_chunks() it reads from a snapshot and does not
+   * block writers.
+   *
+   *
+   * \warning this function throws SerializationError if writing fails.
+   */
+  template <class Serializer = TrivialSerializer<T>>
+  void export_to(int fd, const Serializer& serializer = Serializer()) {
+    Snapshot view = snapshot();
+    write_snapshot(
+        serializer, view.size(),
+        [&view](auto&& visit) { view.for_each(visit); },
+        [fd](const char* data, size_t size) { write_fd(fd, data, size); });
+  }
+
+#ifdef TESTING_MODE
+  /// Need to iterate forward the list and get vector of list values (for
+  /// testing purposes only).
+  std::vector<T> get_fwd() {
+    std::lock_guard<Lock> lock(mutex_);
+    return copy_values(size_, [this](auto&& visit) {
+      scan_forward(head, [&visit](Node* node) {
+        if (is_alive(node)) {
+          visit(node->value);
+        }
+        return false;
+      });
+    });
+  }
+
+  /// Need to iterate backward the list and get vector of list values (for
+  /// testing purposes only).
+  std::vector<T> get_bwd() {
+    std::lock_guard<Lock> lock(mutex_);
+    return copy_values(size_, [this](auto&& visit) {
+      scan_backward(tail, [&visit](Node* node) {
+        if (is_alive(node)) {
+          visit(node->value);
+        }
+        return false;
+      });
+    });
+  }
+
+  /// Need to check that consecutive nodes are adjacent in memory, apart
+  /// from one step per NodePool::kSlab nodes (for testing purposes only).
+  bool is_contiguous() {
+    std::lock_guard<Lock> lock(mutex_);
+    size_t i = 1;
+    for (Node* node = head; node != nullptr && node->next;
+         node = node->next, ++i) {
+      if (i % NodePool<Node>::kSlab != 0 &&
+          node->next != NodePool<Node>::slot(node, 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Need to check that the position index survived the changes so far (for
+  /// testing purposes only).
+  bool is_indexed() {
+    std::lock_guard<Lock> lock(mutex_);
+    return indexed_;
+  }
+
+  /// Need to check how many node slots the shared pool holds (for testing
+  /// purposes only).
+  static size_t pool_reserved() {
+    return NodePool<Node>::instance().reserved();
+  }
+#endif
+
+ private:
+  Node* head;
+  Node* tail;
+  SizeCounter size_;
+  OpLog<T>* log_;             /// receives operation records if attached
+  uint64_t version_;          /// bumped by every mutation
+  std::list<SnapshotState> snapshots_;  /// live read views
+  size_t traversals_;         /// snapshot walks in progress
+  size_t relinkers_;          /// insert_at() calls waiting for the walks
+  std::condition_variable_any walks_done_;  /// see wait_for_traversals()
+  std::vector<Node*> graveyard_;  /// removed nodes that are still linked
+  size_t collect_at_;         /// graveyard size that triggers collect()
+  mutable Lock mutex_;  /// to use std::lock_guard
+
+#ifdef THREAD_SAFE_LIST_COROUTINES
+  using Waiter = PopAwaiter;
+#else
+  struct Waiter {};
+#endif
+  Waiter* waiters_head_;  /// coroutines suspended in async_pop_front()
+  Waiter* waiters_tail_;
+  std::unique_ptr<EventNotifier> notifier_;  /// created by notification_fd()
+  size_t watermark_;  /// size above which notifier_ is signalled as well
+  size_t compact_after_;  /// removals that trigger compact(), 0 if never
+  size_t removals_;       /// removals since the last compaction
+  PositionIndex<Node*> index_;  /// live nodes in list order, see at()
+  bool indexed_;                /// index_ is built and up to date
+  std::chrono::steady_clock::duration ttl_;  /// see set_ttl(), 0 if none
+  bool expiring_;  /// some element was pushed with an expiry time
+  /// Expiry times of the nodes pushed with a TTL. Entries of removed nodes
+  /// may linger until the next sweep, see expires_at().
+  std::unordered_map<const Node*, Expiry> expiry_;
+
+  /// Nodes linked to each other but not to a list yet.
+  struct Chain {
+    Node* first = nullptr;
+    Node* last = nullptr;
+    size_t count = 0;
+  };
+
+  /// Work to do once the lock is released, see wakeups().
+  struct Wakeup {
+    Waiter* ready = nullptr;  /// coroutines to resume
+    EventNotifier* notifier = nullptr;  /// descriptor to signal
+  };
+
+  /// Distance in nodes between a node and its jump pointer target.
+  static constexpr size_t kJumpDistance = 16;
+
+  /// Nodes most recently linked before the head and after the tail, see
+  /// link_front() and link_back(). They get their jump (recent_back_) or
+  /// back jump (recent_front_) pointer written later, so unlink() clears
+  /// them from it.
+  Node* recent_front_[kJumpDistance];
+  Node* recent_back_[kJumpDistance];
+  size_t front_links_;  /// link_front() calls, indexes recent_front_
+  size_t back_links_;   /// link_back() calls, indexes recent_back_
+
+  /// True if values can be copied as raw bytes into a pre-sized vector.
+  static constexpr bool kBitwiseCopy =
+      std::is_trivially_copyable<T>::value &&
+      std::is_default_constructible<T>::value;
+
+  /// Default number of elements a Producer buffers before publishing.
+  static constexpr size_t kProducerBatch = 256;
+
+  /// Minimal graveyard size worth an extra collect() on removal.
+  static constexpr size_t kCollectBatch = 64;
+
+  /// Lingering expiry_ entries tolerated beyond twice the size.
+  static constexpr size_t kSweepSlack = 64;
+
+  /// Size of the buffer used by save() and load().
+  static constexpr size_t kIoChunk = 1 << 16;
+  /// Default number of values handed to an export sink at once.
+  static constexpr size_t kExportChunk = 4096;
+
+  /// Leading block of every snapshot written by save().
+  struct SnapshotHeader {
+    char magic[4];
+    uint32_t element_size;  /// sizeof(T) for raw records, 0 for framed ones
+    uint64_t count;
+  };
+
+  /// Takes storage from the pool and constructs a detached node in it.
+  template <class... Args>
+  static Node* create_node(Args&&... args) {
+    NodePool<Node>& pool = NodePool<Node>::instance();
+    void* storage = pool.allocate();
+    try {
+      return new (storage) Node(std::forward<Args>(args)...);
+    } catch (...) {
+      pool.deallocate(storage);
+      throw;
+    }
+  }
+
+  /// Destroys a detached node and gives its storage back to the pool.
+  static void destroy_node(Node* node) noexcept {
+    node->~Node();
+    NodePool<Node>::instance().deallocate(node);
+  }
+
+  /// Links a detached node before the head. Must be called under the lock.
+  void link_front(Node* node) noexcept {
+    node->born = ++version_;
+    Node*& ahead = recent_front_[front_links_++ % kJumpDistance];
+    node->jump.store(ahead, std::memory_order_relaxed);
+    if (ahead) {
+      ahead->back_jump.store(node, std::memory_order_relaxed);
+    }
+    ahead = node;
+    if (head == nullptr) {  // empty list
+      head = tail = node;
+    } else {
+      node->next = head;
+      head = node;
+      node->next->prev = node;
+    }
+    size_++;
+    if (indexed_) {
+      try {
+        index_.push_front(node);
+      } catch (...) {
+        drop_index();
+      }
+    }
+  }
+
+  /// Links a detached node after the tail. Must be called under the lock.
+  void link_back(Node* node) noexcept {
+    node->prev = tail;
+    node->born = ++version_;
+    if (head == nullptr) {  // empty list
+      head = tail = node;
+    } else {
+      tail->next = node;
+      tail = node;
+    }
+    size_++;
+    index_back(node);
+    jump_to(node);
+  }
+
+  /// Links a detached node right before next, which is at position of the
+  /// content. Must be called under the lock with no traversal in progress.
+  void link_before(Node* next, Node* node, size_t position) noexcept {
+    node->born = ++version_;
+    node->prev = next->prev;  // not null, position > 0
+    node->next = next;
+    next->prev->next = node;
+    next->prev = node;
+    size_++;
+    index_at(node, position);
+  }
+
+  /// Links a new node at one end with the given TTL (or the list one) and
+  /// wakes whoever waits for elements.
+  void push(Node* node, bool to_front,
+            std::optional<std::chrono::steady_clock::duration> ttl) noexcept {
+    Wakeup wakeup;
+    {
+      std::lock_guard<Lock> lock(mutex_);
+      wakeup = push_locked(node, to_front, ttl);
+    }
+    wake(wakeup);
+  }
+
+  /// Body of push(). Must be called under the lock.
+  Wakeup push_locked(Node* node, bool to_front,
+                     std::optional<std::chrono::steady_clock::duration> ttl) {
+    trim_expiry();
+    Expiry* expiry = add_expiry(node, ttl ? *ttl : ttl_);
+    size_t before = size_;
+    if (to_front) {
+      link_front(node);
+      record(ListOp::PushFront, node->value);
+    } else {
+      link_back(node);
+      record(ListOp::PushBack, node->value);
+    }
+    if (expiry) {
+      expiry->born = node->born;
+    }
+    return wakeups(before);
+  }
+
+  /// Adds the expiry entry of a node about to be linked that lives for
+  /// life, or returns nullptr if life is not positive. The entry has born
+  /// 0, which no linked node has, until the caller sets born after
+  /// linking; if linking never happens, it lingers harmlessly. Must be
+  /// called under the lock.
+  Expiry* add_expiry(const Node* node,
+                     std::chrono::steady_clock::duration life) {
+    if (life <= std::chrono::steady_clock::duration::zero()) {
+      return nullptr;
+    }
+    Expiry& entry = expiry_[node];
+    entry = Expiry{std::chrono::steady_clock::now() + life, 0};
+    expiring_ = true;
+    return &entry;
+  }
+
+  /// Sweeps expiry_ once lingering entries outnumber the live nodes. Must
+  /// be called under the lock, outside of transactions.
+  void trim_expiry() {
+    if (expiry_.size() > 2 * size_ + kSweepSlack) {
+      sweep_expiry();
+    }
+  }
+
+  /// Expiry time of a live node, kNever if it was pushed without a TTL.
+  /// Must be called under the lock.
+  std::chrono::steady_clock::time_point expires_at(
+      const Node* node) const noexcept {
+    auto it = expiry_.find(node);
+    // a lingering entry of a removed node never matches a node linked later
+    return it != expiry_.end() && it->second.born == node->born
+               ? it->second.at
+               : kNever;
+  }
+
+  /// Drops the lingering entries from expiry_. Must be called under the
+  /// lock, outside of transactions.
+  void sweep_expiry() {
+    std::unordered_map<const Node*, Expiry> live;
+    for (Node* node = head; node != nullptr; node = node->next) {
+      std::chrono::steady_clock::time_point at = expires_at(node);
+      if (at != kNever && is_alive(node)) {
+        live.emplace(node, Expiry{at, node->born});
+      }
+    }
+    expiry_.swap(live);
+  }
+
+  /// Removes the first element equal to val, returns false if there is
+  /// none. Must be called under the lock.
+  bool remove_locked(const T& val) {
+    size_t position = kNoPosition;
+    Node* found_node = find(val, indexed_ ? &position : nullptr);
+
+    if (!found_node) {  // nothing to delete
+      return false;
+    }
+    record(ListOp::Remove, val);
+    retire(found_node, position);
+    note_removal();
+    return true;
+  }
+
+  /// front_if_any() and back_if_any().
+  std::optional<T> peek(bool from_front) {
+    std::lock_guard<Lock> lock(mutex_);
+    drop_expired(from_front);
+    Node* node = from_front ? first_alive(head) : last_alive(tail);
+    return node ? std::optional<T>(node->value) : std::nullopt;
+  }
+
+  /// pop_front_if_any() and pop_back_if_any().
+  std::optional<T> pop_if_any(bool from_front) {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = pop_candidate(from_front);
+    if (!node) {
+      return std::nullopt;
+    }
+    std::optional<T> value(
+        take(node, from_front ? ListOp::PopFront : ListOp::PopBack));
+    note_removal();
+    return value;
+  }
+
+  /// Node a pop at one end would remove, after dropping expired elements
+  /// there; nullptr if there is none. Must be called under the lock.
+  Node* pop_candidate(bool from_front) {
+    drop_expired(from_front);
+    return from_front ? first_alive(head) : last_alive(tail);
+  }
+
+  /** \brief Runs op(Wakeup&) under the lock if it can be taken in time.
+   * \param deadline latest time to wait for the lock, none to try once
+   *
+   * op returns the status of the operation and may fill in wake-ups, which
+   * are performed after the lock is released.
+   */
+  template <class Op>
+  ListStatus try_locked(
+      std::optional<std::chrono::steady_clock::time_point> deadline, Op op) {
+    if (!(deadline ? lock_until(mutex_, *deadline, 0) : mutex_.try_lock())) {
+      return deadline ? ListStatus::Timeout : ListStatus::Busy;
+    }
+    std::unique_lock<Lock> lock(mutex_, std::adopt_lock);
+    Wakeup wakeup;
+    ListStatus status = op(wakeup);
+    lock.unlock();
+    wake(wakeup);
+    return status;
+  }
+
+  /// try_ and _for pushes, the node is destroyed if the lock is not taken.
+  ListStatus try_push(
+      Node* node, bool to_front,
+      std::optional<std::chrono::steady_clock::time_point> deadline) noexcept {
+    ListStatus status = try_locked(deadline, [&](Wakeup& wakeup) {
+      wakeup = push_locked(node, to_front, std::nullopt);
+      return ListStatus::Ok;
+    });
+    if (status != ListStatus::Ok) {
+      destroy_node(node);
+    }
+    return status;
+  }
+
+  /// try_ and _for pops.
+  ListStatus try_pop(
+      T& out, bool from_front,
+      std::optional<std::chrono::steady_clock::time_point> deadline) {
+    return try_locked(deadline, [&](Wakeup&) {
+      Node* node = pop_candidate(from_front);
+      if (!node) {
+        return ListStatus::Empty;
+      }
+      out = take(node, from_front ? ListOp::PopFront : ListOp::PopBack);
+      note_removal();
+      return ListStatus::Ok;
+    });
+  }
+
+  /// Time point timeout from now, a negative timeout counts as zero.
+  static std::chrono::steady_clock::time_point deadline_in(
+      std::chrono::steady_clock::duration timeout) noexcept {
+    return std::chrono::steady_clock::now() +
+           std::max(timeout, std::chrono::steady_clock::duration::zero());
+  }
+
+  /// Takes a lock that has try_lock_until() before deadline.
+  template <class L>
+  static auto lock_until(L& lock,
+                         std::chrono::steady_clock::time_point deadline, int)
+      -> decltype(lock.try_lock_until(deadline)) {
+    return lock.try_lock_until(deadline);
+  }
+
+  /// Takes a lock without try_lock_until() before deadline by polling.
+  template <class L>
+  static bool lock_until(L& lock,
+                         std::chrono::steady_clock::time_point deadline,
+                         long) {
+    constexpr uint32_t kSpins = 64;  // polls with cpu_relax() before yield
+    for (uint32_t attempt = 0;; ++attempt) {
+      if (lock.try_lock()) {
+        return true;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      if (attempt < kSpins) {
+        cpu_relax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /** \brief Removes the expired elements at one end, up to the first one
+   * that has not expired.
+   *
+   * Does nothing (and does not read the clock) unless some element was
+   * pushed with a TTL. Must be called under the lock, outside of
+   * transactions.
+   *
+   * \return Outputs number of removed elements.
+   */
+  size_t drop_expired(bool from_front,
+                      std::chrono::steady_clock::time_point now = kNever) {
+    if (!expiring_) {
+      return 0;
+    }
+    if (now == kNever) {
+      now = std::chrono::steady_clock::now();
+    }
+    size_t dropped = 0;
+    for (;;) {
+      Node* node = from_front ? first_alive(head) : last_alive(tail);
+      if (!node || expires_at(node) > now) {
+        break;
+      }
+      record(from_front ? ListOp::PopFront : ListOp::PopBack, node->value);
+      retire(node);
+      expiry_.erase(node);
+      ++dropped;
+    }
+    note_removal(dropped);
+    return dropped;
+  }
+
+  /// Moves an element from one end of this list to one end of dst.
+  void move_to(ThreadSafeList2D& dst, bool from_front, bool to_front) {
+    MultiLock<Lock, 2> locks({&mutex_, &dst.mutex_});  // once if dst is this
+    size_t dst_before = dst.size_;
+
+    Node* node = pop_candidate(from_front);  // expired ones are not moved
+    if (!node) {
+      throw AcceessViolation();
+    }
+    const std::chrono::steady_clock::time_point expires = expires_at(node);
+    Node* moved = snapshots_.empty() ? node : create_node(node->value);
+    try {
+      if (expires != kNever) {  // the element keeps its expiry time
+        dst.expiry_[moved] = Expiry{expires, 0};
+      }
+      if (moved != node) {
+        retire(node);
+      }
+    } catch (...) {
+      if (moved != node) {
+        destroy_node(moved);
+      }
+      throw;
+    }
+    if (moved == node) {
+      unindex(node);
+      unlink(node);
+      size_--;
+      node->prev = node->next = nullptr;
+    }
+    record(from_front ? ListOp::PopFront : ListOp::PopBack, moved->value);
+    if (to_front) {
+      dst.link_front(moved);
+    } else {
+      dst.link_back(moved);
+    }
+    dst.record(to_front ? ListOp::PushFront : ListOp::PushBack, moved->value);
+    if (expires != kNever) {
+      dst.expiry_.find(moved)->second.born = moved->born;
+      dst.expiring_ = true;
+    }
+    Wakeup wakeup = dst.wakeups(dst_before);
+    locks.unlock();
+    wake(wakeup);
+  }
+
+  /// Opens a Transaction on each of the first Count lists, calls fn with
+  /// all of them and commits them. Must be called with every lock held.
+  template <size_t Count, class Fn, class... Txs>
+  static auto run_transactions(Fn& fn, ThreadSafeList2D* const* lists,
+                               Txs&... txs) {
+    if constexpr (Count == 0) {
+      if constexpr (std::is_void<decltype(fn(txs...))>::value) {
+        fn(txs...);
+        (txs.commit(), ...);
+      } else {
+        auto result = fn(txs...);
+        (txs.commit(), ...);
+        return result;
+      }
+    } else {
+      Transaction tx(*lists[0]);
+      return run_transactions<Count - 1>(fn, lists + 1, txs..., tx);
+    }
+  }
+
+  /// Collects wake-ups due after elements were added to a list that held
+  /// before elements. Must be called under the lock.
+  Wakeup wakeups(size_t before) {
+    Wakeup wakeup;
+    wakeup.ready = ready_waiters();
+    if (notifier_ && size_ > before &&
+        (before == 0 || (watermark_ > 0 && before <= watermark_ &&
+                         size_ > watermark_))) {
+      wakeup.notifier = notifier_.get();
+    }
+    return wakeup;
+  }
+
+  /// Performs wake-ups returned by wakeups(), without the lock.
+  static void wake(const Wakeup& wakeup) noexcept {
+    resume_waiters(wakeup.ready);
+    if (wakeup.notifier) {
+      wakeup.notifier->signal();
+    }
+  }
+
+  /// Hands elements to queued coroutines while both exist and returns the
+  /// satisfied ones. Expired elements are dropped first, as by every pop.
+  /// Must be called under the lock, outside of transactions.
+  Waiter* ready_waiters() {
+#ifdef THREAD_SAFE_LIST_COROUTINES
+    Waiter* ready = nullptr;
+    Waiter** ready_tail = &ready;
+    while (waiters_head_) {
+      Node* node = pop_candidate(true);
+      if (!node) {
+        break;
+      }
+      Waiter* waiter = waiters_head_;
+      waiter->value_.emplace(take(node, ListOp::PopFront));
+      note_removal();
+      waiters_head_ = waiter->next_;
+      if (!waiters_head_) {
+        waiters_tail_ = nullptr;
+      }
+      waiter->queued_ = false;
+      waiter->next_ = nullptr;
+      *ready_tail = waiter;
+      ready_tail = &waiter->next_;
+    }
+    return ready;
+#else
+    return nullptr;
+#endif
+  }
+
+  /// Resumes coroutines returned by ready_waiters(), without the lock.
+  static void resume_waiters(Waiter* ready) {
+#ifdef THREAD_SAFE_LIST_COROUTINES
+    while (ready) {
+      Waiter* next = ready->next_;  // resuming may destroy the awaiter
+      ready->dispatch();
+      ready = next;
+    }
+#else
+    (void)ready;
+#endif
+  }
+
+#ifdef THREAD_SAFE_LIST_COROUTINES
+  /// Removes a queued waiter whose coroutine is destroyed. Must be called
+  /// under the lock.
+  void cancel_waiter(Waiter* waiter) noexcept {
+    Waiter* prev = nullptr;
+    for (Waiter* it = waiters_head_; it != waiter; it = it->next_) {
+      prev = it;
+    }
+    (prev ? prev->next_ : waiters_head_) = waiter->next_;
+    if (waiters_tail_ == waiter) {
+      waiters_tail_ = prev;
+    }
+    waiter->queued_ = false;
+  }
+#endif
+
+  /// Detaches a linked node from the chain without touching size_. Must be
+  /// called under the lock.
+  void unlink(Node* node) noexcept {
+    for (Node*& recent : recent_back_) {
+      if (recent == node) {
+        recent = nullptr;  // may be freed before its jump is due
+      }
+    }
+    for (Node*& recent : recent_front_) {
+      if (recent == node) {
+        recent = nullptr;  // may be freed before its back jump is due
+      }
+    }
+    if (node->prev) {
+      node->prev->next = node->next;
+    } else {
+      head = node->next;
+    }
+    if (node->next) {
+      node->next->prev = node->prev;
+    } else {
+      tail = node->prev;
+    }
+  }
+
+  static bool is_alive(const Node* node) noexcept {
+    return node->died.load(std::memory_order_relaxed) == kAlive;
+  }
+
+  /// First node of the content starting from node. Must be called under the
+  /// lock.
+  static Node* first_alive(Node* node) noexcept {
+    while (node && !is_alive(node)) {
+      node = node->next;
+    }
+    return node;
+  }
+
+  /// Last node of the content starting backwards from node. Must be called
+  /// under the lock.
+  static Node* last_alive(Node* node) noexcept {
+    while (node && !is_alive(node)) {
+      node = node->prev;
+    }
+    return node;
+  }
+
+  /// Removes a node from the content: frees it right away if nobody can see
+  /// it, otherwise stamps it with a new version. position is passed on to
+  /// unindex(). Must be called under the lock.
+  void retire(Node* node, size_t position = kNoPosition) {
+    unindex(node, position);
+    if (snapshots_.empty()) {
+      unlink(node);
+      destroy_node(node);
+    } else {
+      graveyard_.push_back(node);
+      node->died.store(++version_, std::memory_order_relaxed);
+      if (traversals_ == 0 && graveyard_.size() >= collect_at_) {
+        collect();
+        collect_at_ = std::max(kCollectBatch, 2 * graveyard_.size());
+      }
+    }
+    size_--;
+  }
+
+  /// Records op, removes node and returns its value. Must be called under
+  /// the lock.
+  T take(Node* node, ListOp op, size_t position = 0) {
+    record(op, node->value, position);
+    if (!snapshots_.empty()) {
+      T value = node->value;  // snapshots may still read the node
+      retire(node);
+      return value;
+    }
+    T value = std::move(node->value);
+    retire(node);
+    return value;
+  }
+
+  /** \brief Frees removed nodes that no snapshot can see any more.
+   *
+   * A node removed at version d is invisible to every view older than d, so
+   * everything with d <= the oldest live snapshot version is unlinked.
+   * Snapshot ranges that start or end at such a node are narrowed.
+   *
+   * \warning Must be called under the lock with no traversal in progress.
+   */
+  void collect() noexcept {
+    uint64_t horizon = kAlive;
+    for (const SnapshotState& state : snapshots_) {
+      horizon = std::min(horizon, state.version);
+    }
+    size_t kept = 0;
+    for (Node* node : graveyard_) {
+      if (node->died.load(std::memory_order_relaxed) > horizon) {
+        graveyard_[kept++] = node;
+        continue;
+      }
+      for (SnapshotState& state : snapshots_) {
+        if (state.first == node && state.last == node) {
+          state.first = state.last = nullptr;
+        } else if (state.first == node) {
+          state.first = node->next;
+        } else if (state.last == node) {
+          state.last = node->prev;
+        }
+      }
+      unlink(node);
+      destroy_node(node);
+    }
+    graveyard_.resize(kept);
+  }
+
+  /// Unregisters a snapshot. Called by ~Snapshot.
+  void release(typename std::list<SnapshotState>::iterator state) noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    snapshots_.erase(state);
+    if (traversals_ == 0) {
+      collect();
+    }
+  }
+
+  /// Walks the range of a snapshot without holding the lock.
+  template <class Fn>
+  void traverse(const SnapshotState& state, Fn& fn) {
+    Node* node;
+    Node* last;
+    {
+      std::unique_lock<Lock> lock(mutex_);
+      if (walk_depth() == 0) {  // a nested walk would wait for itself
+        walks_done_.wait(lock, [this] { return relinkers_ == 0; });
+      }
+      ++traversals_;
+      node = state.first;
+      last = state.last;
+    }
+    ++walk_depth();
+    struct Finish {
+      ThreadSafeList2D* list;
+      ~Finish() {
+        --walk_depth();
+        std::lock_guard<Lock> lock(list->mutex_);
+        if (--list->traversals_ == 0) {
+          list->collect();
+          if (list->relinkers_ > 0) {
+            list->walks_done_.notify_all();
+          }
+        }
+      }
+    } finish{this};
+
+    // Nodes of the range are neither unlinked nor freed while traversals_
+    // is non-zero, and pushes only link nodes outside of it.
+    while (node != nullptr) {
+      prefetch(node->jump.load(std::memory_order_relaxed));
+      Node* next = node == last ? nullptr : node->next;
+      if (node->born <= state.version &&
+          node->died.load(std::memory_order_relaxed) > state.version) {
+        fn(static_cast<const T&>(node->value));
+      }
+      node = next;
+    }
+  }
+
+  /// Number of snapshot walks the calling thread is inside of.
+  static size_t& walk_depth() noexcept {
+    static thread_local size_t depth = 0;
+    return depth;
+  }
+
+  /** \brief Waits until no snapshot walk is in progress.
+   *
+   * Walks that want to start meanwhile wait until the last waiting call is
+   * done, so a steady stream of walks cannot starve it. Must be called with
+   * lock holding the list lock.
+   */
+  void wait_for_traversals(std::unique_lock<Lock>& lock) {
+    ++relinkers_;
+    try {
+      walks_done_.wait(lock, [this] { return traversals_ == 0; });
+    } catch (...) {
+      if (--relinkers_ == 0) {
+        walks_done_.notify_all();
+      }
+      throw;
+    }
+    if (--relinkers_ == 0) {
+      walks_done_.notify_all();  // let the held back walks start
+    }
+  }
+
+  /// Appends a record to the attached log. Must be called under the lock.
+  void record(ListOp op, const T& value, size_t position = 0) {
+    if (log_) {
+      log_->append(op, value, position);
+    }
+  }
+
+  /// Forgets the position index until the next positional call.
+  void drop_index() noexcept {
+    indexed_ = false;
+    index_.clear();
+  }
+
+  /// Makes node, just linked after the tail, the jump target of the node
+  /// linked there kJumpDistance links earlier, and that node its back jump
+  /// target. Must be called under the lock.
+  void jump_to(Node* node) noexcept {
+    Node*& behind = recent_back_[back_links_++ % kJumpDistance];
+    node->back_jump.store(behind, std::memory_order_relaxed);
+    if (behind) {
+      behind->jump.store(node, std::memory_order_relaxed);
+    }
+    behind = node;
+  }
+
+  /// Forgets the recently linked nodes, e.g. before the whole chain is freed.
+  void forget_recent() noexcept {
+    std::fill(std::begin(recent_front_), std::end(recent_front_), nullptr);
+    std::fill(std::begin(recent_back_), std::end(recent_back_), nullptr);
+  }
+
+  /// Appends a node just linked after the tail to the index, if it is built.
+  void index_back(Node* node) noexcept {
+    if (indexed_) {
+      try {
+        index_.push_back(node);
+      } catch (...) {
+        drop_index();
+      }
+    }
+  }
+
+  /// Inserts a node just linked or relinked at position into the index, if
+  /// it is built. Must be called under the lock.
+  void index_at(Node* node, size_t position) noexcept {
+    if (indexed_) {
+      try {
+        index_.insert(position, node);
+      } catch (...) {
+        drop_index();
+      }
+    }
+  }
+
+  /// Keeps the index in step with the removal of a live node: removals at
+  /// either end are cheap, others take the position the caller counted on
+  /// its way to the node, without it they drop the index. Must be called
+  /// under the lock.
+  void unindex(Node* node, size_t position = kNoPosition) noexcept {
+    if (!indexed_) {
+      return;
+    }
+    if (index_.front() == node) {
+      index_.pop_front();
+    } else if (index_.back() == node) {
+      index_.pop_back();
+    } else if (position != kNoPosition) {
+      index_.erase(position);
+    } else {
+      drop_index();
+    }
+  }
+
+  /// Builds the index over the live nodes. Must be called under the lock.
+  void build_index() {
+    try {
+      for (Node* node = first_alive(head); node != nullptr;
+           node = first_alive(node->next)) {
+        index_.push_back(node);
+      }
+    } catch (...) {
+      index_.clear();
+      throw;
+    }
+    indexed_ = true;
+  }
+
+  /// Returns the live node at position, building the index if needed. Must
+  /// be called under the lock.
+  Node* indexed_node(size_t position) {
+    if (position >= size_) {
+      throw AcceessViolation();
+    }
+    if (!indexed_) {
+      build_index();
+    }
+    return index_.at(position);
+  }
+
+  /// Returns true if snapshots written with Serializer use raw records.
+  template <class Serializer>
+  static constexpr bool is_raw_format() {
+    return std::is_same<Serializer, TrivialSerializer<T>>::value;
+  }
+
+  /// Links an already built chain of count nodes after the tail.
+  void splice_back(Node* first, Node* last, size_t count) {
+    std::unique_lock<Lock> lock(mutex_);
+    size_t before = size_;
+    append_chain(Chain{first, last, count});
+    Wakeup wakeup = wakeups(before);
+    lock.unlock();
+    wake(wakeup);
+  }
+
+  /// Links a chain after the tail as one version, its nodes expire as set
+  /// by set_ttl(). Must be called under the lock, outside of transactions.
+  void append_chain(const Chain& chain) {
+    const bool expiring = ttl_ > std::chrono::steady_clock::duration::zero();
+    if (expiring) {
+      trim_expiry();
+      for (Node* node = chain.first; node != nullptr; node = node->next) {
+        add_expiry(node, ttl_);  // before linking, so a failure changes nothing
+      }
+    }
+    if (tail) {
+      tail->next = chain.first;
+      chain.first->prev = tail;
+    } else {
+      head = chain.first;
+    }
+    tail = chain.last;
+    size_ += chain.count;
+    uint64_t born = ++version_;
+    for (Node* node = chain.first; node != nullptr; node = node->next) {
+      node->born = born;
+      if (expiring) {
+        expiry_.find(node)->second.born = born;
+      }
+      record(ListOp::PushBack, node->value);
+      index_back(node);
+      jump_to(node);
+    }
+  }
+
+  /// Relocates the nodes into contiguous slabs, see compact(). Must be
+  /// called under the lock.
+  bool compact_locked() {
+    if (!snapshots_.empty()) {
+      return false;
+    }
+    removals_ = 0;
+    if (size_ < 2) {
+      return true;
+    }
+    const bool indexed = indexed_;
+    drop_index();  // every node is relocated, rebuilt below
+    // Without snapshots there are no retired nodes: the chain is size_ long.
+    const size_t count = size_;
+    std::vector<void*> slabs;
+    size_t built = 0;
+    std::unordered_map<const Node*, Expiry> expiry;  // for the new nodes
+    try {
+      // Filled before any value is moved out, so a failure loses nothing.
+      allocate_slabs(count, slabs);
+      size_t i = 0;
+      for (Node* node = head; !expiry_.empty() && node != nullptr;
+           node = node->next, ++i) {
+        std::chrono::steady_clock::time_point at = expires_at(node);
+        if (at != kNever) {
+          expiry.emplace(slab_node(slabs, i), Expiry{at, node->born});
+        }
+      }
+      for (Node* node = head; node != nullptr; node = node->next, ++built) {
+        Node* copy = new (slab_node(slabs, built))
+            Node(std::move_if_noexcept(node->value),
+                 built ? slab_node(slabs, built - 1) : nullptr);
+        copy->born = node->born;
+      }
+    } catch (...) {
+      free_slabs(slabs, count, built);
+      throw;
+    }
+    for (size_t i = 0; i + 1 < count; ++i) {
+      slab_node(slabs, i)->next = slab_node(slabs, i + 1);
+    }
+    forget_recent();  // the nodes are sequential now, no jumps needed
+    expiry_.swap(expiry);
+    destroy_chain(head, tail);
+    head = slab_node(slabs, 0);
+    tail = slab_node(slabs, count - 1);
+    if (indexed) {
+      try {
+        build_index();  // O(n) like the compaction itself
+      } catch (...) {
+        // the next positional call builds it
+      }
+    }
+    return true;
+  }
+
+  /// Counts removals and compacts when the threshold is reached. Must be
+  /// called under the lock, outside of transactions.
+  void note_removal(size_t count = 1) noexcept {
+    if (compact_after_ == 0 || count == 0 ||
+        (removals_ += count) < compact_after_) {
+      return;
+    }
+    try {
+      compact_locked();
+    } catch (...) {
+      removals_ = 0;  // compaction is an optimization, skip it this time
+    }
+  }
+
+  /// Takes over a chain in a constructor, before the list is shared.
+  void adopt(const Chain& chain) noexcept {
+    head = chain.first;
+    tail = chain.last;
+    size_ = chain.count;
+  }
+
+  /** \brief Builds an unlinked chain holding copies of [first, last).
+   *
+   * Forward ranges are counted first and placed in contiguous slabs;
+   * single-pass input ranges get nodes one by one. Nothing leaks if a copy
+   * throws.
+   */
+  template <class InputIt>
+  static Chain build_chain(InputIt first, InputIt last) {
+    using Category = typename std::iterator_traits<InputIt>::iterator_category;
+    Chain chain;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+      const size_t count = static_cast<size_t>(std::distance(first, last));
+      if (count == 0) {
+        return chain;
+      }
+      std::vector<void*> slabs;
+      size_t built = 0;
+      try {
+        allocate_slabs(count, slabs);
+        for (; built < count; ++built, ++first) {
+          new (slab_node(slabs, built)) Node(
+              T(*first), built ? slab_node(slabs, built - 1) : nullptr);
+        }
+      } catch (...) {
+        free_slabs(slabs, count, built);
+        throw;
+      }
+      for (size_t i = 0; i + 1 < count; ++i) {
+        slab_node(slabs, i)->next = slab_node(slabs, i + 1);
+      }
+      chain = Chain{slab_node(slabs, 0), slab_node(slabs, count - 1), count};
+    } else {
+      try {
+        for (; first != last; ++first) {
+          Node* node = create_node(T(*first));
+          if (chain.last) {
+            chain.last->next = node;
+            node->prev = chain.last;
+          } else {
+            chain.first = node;
+          }
+          chain.last = node;
+          ++chain.count;
+        }
+      } catch (...) {
+        destroy_chain(chain.first, chain.last);
+        throw;
+      }
+    }
+    return chain;
+  }
+
+  /// Takes storage for count nodes from the pool in contiguous slabs of up
+  /// to NodePool::kSlab nodes and adds the first node of each to slabs.
+  /// The slabs taken before a failure stay in slabs, see free_slabs().
+  static void allocate_slabs(size_t count, std::vector<void*>& slabs) {
+    constexpr size_t kSlab = NodePool<Node>::kSlab;
+    NodePool<Node>& pool = NodePool<Node>::instance();
+    slabs.reserve((count + kSlab - 1) / kSlab);
+    for (size_t i = 0; i < count; i += kSlab) {
+      slabs.push_back(pool.allocate_contiguous(std::min(count - i, kSlab)));
+    }
+  }
+
+  /// Returns the storage of node i of the slabs taken by allocate_slabs().
+  static Node* slab_node(const std::vector<void*>& slabs, size_t i) noexcept {
+    constexpr size_t kSlab = NodePool<Node>::kSlab;
+    return static_cast<Node*>(
+        NodePool<Node>::slot(slabs[i / kSlab], i % kSlab));
+  }
+
+  /// Gives back the slabs taken by allocate_slabs() for count nodes, of
+  /// which the first built were constructed.
+  static void free_slabs(const std::vector<void*>& slabs, size_t count,
+                         size_t built) noexcept {
+    NodePool<Node>& pool = NodePool<Node>::instance();
+    count = std::min(count, slabs.size() * NodePool<Node>::kSlab);
+    for (size_t i = 0; i < count; ++i) {
+      Node* node = slab_node(slabs, i);
+      if (i < built) {
+        node->~Node();
+      }
+      pool.deallocate(node);
+    }
+  }
+
+  /// Destroys a null-terminated chain of nodes that is not shared.
+  static void destroy_chain(Node* first, Node* last) noexcept {
+    if constexpr (std::is_trivially_destructible<Node>::value) {
+      // Nothing to destroy: the chain goes back to the pool in one step.
+      if (first) {
+        NodePool<Node>::instance().deallocate_chain(first, last);
+      }
+    } else {
+      (void)last;
+      scan_forward(first, [](Node* node) {
+        destroy_node(node);
+        return false;
+      });
+    }
+  }
+
+  template <class Serializer, class Writer>
+  void save_with(const Serializer& serializer, Writer&& write) {
+    std::lock_guard<Lock> lock(mutex_);
+    write_snapshot(
+        serializer, size_,
+        [this](auto&& visit) {
+          for (Node* node = head; node != nullptr; node = node->next) {
+            if (is_alive(node)) {
+              visit(node->value);
+            }
+          }
+        },
+        write);
+  }
+
+  /// Copies the count values produced by for_each(visitor) into a vector.
+  /// Trivially copyable values are memcpy'd into a vector sized once.
+  template <class ForEach>
+  static std::vector<T> copy_values(size_t count, ForEach&& for_each) {
+    std::vector<T> result;
+    if constexpr (kBitwiseCopy) {
+      result.resize(count);
+      T* out = result.data();
+      for_each([&out](const T& value) {
+        std::memcpy(out++, &value, sizeof(T));
+      });
+    } else {
+      result.reserve(count);
+      for_each([&result](const T& value) { result.push_back(value); });
+    }
+    return result;
+  }
+
+  /// Encodes count values produced by for_each(visitor) in save() format.
+  template <class Serializer, class ForEach, class Writer>
+  static void write_snapshot(const Serializer& serializer, size_t count,
+                             ForEach&& for_each, Writer&& write) {
+    SnapshotHeader header = {
+        {'T', 'S', 'L', '2'},
+        static_cast<uint32_t>(is_raw_format<Serializer>() ? sizeof(T) : 0),
+        count};
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::string encoded;
+    for_each([&](const T& value) {
+      if constexpr (is_raw_format<Serializer>()) {
+        serializer.write(value, buffer);
+      } else {
+        encoded.clear();
+        serializer.write(value, encoded);
+        if (encoded.size() > UINT32_MAX) {
+          throw SerializationError();
+        }
+        uint32_t length = static_cast<uint32_t>(encoded.size());
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(encoded);
+      }
+      if (buffer.size() >= kIoChunk) {
+        write(buffer.data(), buffer.size());
+        buffer.clear();
+      }
+    });
+    write(buffer.data(), buffer.size());
+  }
+
+  /** \brief Decodes a snapshot and appends it to the list.
+   * \param available bytes left in the input, none if unknown
+   *
+   * Every record takes at least sizeof(T) bytes (raw) or its length prefix
+   * (framed), so a count that cannot fit into the input is rejected before
+   * allocating. Framed payloads are read kIoChunk bytes at a time and never
+   * past the known end of the input.
+   */
+  template <class Serializer, class Reader>
+  void load_with(const Serializer& serializer, Reader&& read,
+                 std::optional<uint64_t> available) {
+    SnapshotHeader header;
+    read(reinterpret_cast<char*>(&header), sizeof(header));
+    const uint32_t element_size =
+        static_cast<uint32_t>(is_raw_format<Serializer>() ? sizeof(T) : 0);
+    if (std::memcmp(header.magic, "TSL2", sizeof(header.magic)) != 0 ||
+        header.element_size != element_size) {
+      throw SerializationError();
+    }
+    if (header.count == 0) {
+      return;
+    }
+    constexpr uint64_t kMinRecord =
+        is_raw_format<Serializer>() ? sizeof(T) : sizeof(uint32_t);
+    if (available) {
+      *available -= std::min<uint64_t>(*available, sizeof(header));
+      if (header.count > *available / kMinRecord) {
+        throw SerializationError();
+      }
+    }
+    if (header.count > SIZE_MAX / sizeof(Node)) {
+      throw SerializationError();
+    }
+
+    const size_t count = static_cast<size_t>(header.count);
+    NodePool<Node>& pool = NodePool<Node>::instance();
+    Chain chain;
+    try {
+      std::string buffer;
+      uint32_t length = 0;
+      while (chain.count < count) {
+        const size_t slab =
+            std::min(count - chain.count, NodePool<Node>::kSlab);
+        void* nodes = pool.allocate_contiguous(slab);
+        size_t built = 0;
+        // Constructed nodes are linked into chain at once, so the handler
+        // below only has to give the remaining slots back.
+        auto append = [&](T value) {
+          Node* node = new (NodePool<Node>::slot(nodes, built))
+              Node(std::move(value), chain.last);
+          (chain.last ? chain.last->next : chain.first) = node;
+          chain.last = node;
+          ++chain.count;
+          ++built;
+        };
+        try {
+          while (built < slab) {
+            if constexpr (is_raw_format<Serializer>()) {
+              size_t batch = std::min(
+                  slab - built, std::max<size_t>(1, kIoChunk / sizeof(T)));
+              buffer.resize(batch * sizeof(T));
+              read(&buffer[0], buffer.size());
+              for (size_t i = 0; i < batch; ++i) {
+                append(serializer.read(buffer.data() + i * sizeof(T),
+                                       sizeof(T)));
+              }
+            } else {
+              read(reinterpret_cast<char*>(&length), sizeof(length));
+              if (available) {
+                *available -= sizeof(length);
+                if (length > *available) {
+                  throw SerializationError();
+                }
+                *available -= length;
+              }
+              buffer.clear();
+              while (buffer.size() < length) {
+                size_t done = buffer.size();
+                buffer.resize(done + std::min<size_t>(length - done, kIoChunk));
+                read(&buffer[done], buffer.size() - done);
+              }
+              append(serializer.read(buffer.data(), length));
+            }
+          }
+        } catch (...) {
+          for (size_t i = built; i < slab; ++i) {
+            pool.deallocate(NodePool<Node>::slot(nodes, i));
+          }
+          throw;
+        }
+      }
+    } catch (...) {
+      destroy_chain(chain.first, chain.last);
+      throw;
+    }
+    splice_back(chain.first, chain.last, chain.count);
+  }
+
+  /// Bytes left in a stream, none if it cannot seek.
+  static std::optional<uint64_t> remaining_bytes(std::istream& in) {
+    const std::istream::pos_type here = in.tellg();
+    if (here == std::istream::pos_type(-1)) {
+      return std::nullopt;
+    }
+    if (!in.seekg(0, std::ios_base::end)) {
+      in.clear();
+      return std::nullopt;
+    }
+    const std::istream::pos_type end = in.tellg();
+    in.seekg(here);
+    if (end == std::istream::pos_type(-1) || end < here) {
+      return std::nullopt;
+    }
+    return static_cast<uint64_t>(end - here);
+  }
+
+  /// Bytes left in a file, none if fd cannot seek (pipes, sockets).
+  static std::optional<uint64_t> remaining_bytes(int fd) noexcept {
+#ifdef _WIN32
+    const long long here = _lseeki64(fd, 0, SEEK_CUR);
+    const long long end = here < 0 ? -1 : _lseeki64(fd, 0, SEEK_END);
+    if (end >= 0) {
+      _lseeki64(fd, here, SEEK_SET);
+    }
+#else
+    const off_t here = ::lseek(fd, 0, SEEK_CUR);
+    const off_t end = here < 0 ? -1 : ::lseek(fd, 0, SEEK_END);
+    if (end >= 0) {
+      ::lseek(fd, here, SEEK_SET);
+    }
+#endif
+    if (here < 0 || end < here) {
+      return std::nullopt;
+    }
+    return static_cast<uint64_t>(end - here);
+  }
+
+  static void write_fd(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+      int done = _write(fd, data,
+                        static_cast<unsigned>(std::min(size, kIoChunk)));
+#else
+      ssize_t done = ::write(fd, data, size);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+#endif
+      if (done <= 0) {
+        throw SerializationError();
+      }
+      data += done;
+      size -= static_cast<size_t>(done);
+    }
+  }
+
+  static void read_fd(int fd, char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+      int done = _read(fd, data,
+                       static_cast<unsigned>(std::min(size, kIoChunk)));
+#else
+      ssize_t done = ::read(fd, data, size);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+#endif
+      if (done <= 0) {  // error or unexpected end of file
+        throw SerializationError();
+      }
+      data += done;
+      size -= static_cast<size_t>(done);
+    }
+  }
+
+  /// Removes the first live element matching pred, see remove_by_key().
+  /// The removal is logged as EraseAt of its position: a replica replaying
+  /// Remove would match with operator==, which may pick another element.
+  template <class Pred>
+  void remove_if_found(Pred pred) {
+    std::lock_guard<Lock> lock(mutex_);
+    size_t position = 0;
+    Node* found_node = scan_forward(head, [&pred, &position](Node* node) {
+      if (!is_alive(node)) {
+        return false;
+      }
+      if (pred(static_cast<const T&>(node->value))) {
+        return true;
+      }
+      ++position;
+      return false;
+    });
+    if (!found_node) {
+      throw ElementNotFound();
+    }
+    record(ListOp::EraseAt, found_node->value, position);
+    retire(found_node, position);
+    note_removal();
+  }
+
+  /// Copies the first live element matching pred, see find_by().
+  template <class Pred>
+  T copy_if_found(Pred pred) {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* found_node = find_if(pred);
+    if (!found_node) {
+      throw ElementNotFound();
+    }
+    return found_node->value;
+  }
+
+  /// Returns the first live node whose value matches pred, or nullptr.
+  template <class Pred>
+  Node* find_if(Pred& pred) {
+    return scan_forward(head, [&pred](Node* node) {
+      return is_alive(node) && pred(static_cast<const T&>(node->value));
+    });
+  }
+
+  /// Hints the CPU to start loading the cache line at address, if any.
+  /// The address may be dangling: a prefetch never faults.
+  static void prefetch(const void* address) noexcept {
+    if (address == nullptr) {
+      return;
+    }
+#if defined(THREAD_SAFE_LIST_NO_PREFETCH)
+    (void)address;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+  }
+
+  /** \brief Walks the chain from node along next links.
+   *
+   * Returns the first node for which pred(node) is true, nullptr if there
+   * is none. Each visited node's jump pointer is prefetched; nothing is
+   * written, and pred may destroy the node it gets. Must be called under
+   * the lock.
+   */
+  template <class Pred>
+  static Node* scan_forward(Node* node, Pred&& pred) {
+    while (node != nullptr) {
+      prefetch(node->jump.load(std::memory_order_relaxed));
+      Node* next = node->next;
+      if (pred(node)) {
+        return node;
+      }
+      node = next;
+    }
+    return nullptr;
+  }
+
+  /** \brief Walks the chain from node along prev links.
+   *
+   * Same as scan_forward() in the other direction, prefetching through the
+   * back jump pointers. Must be called under the lock.
+   */
+  template <class Pred>
+  static Node* scan_backward(Node* node, Pred&& pred) {
+    while (node != nullptr) {
+      prefetch(node->back_jump.load(std::memory_order_relaxed));
+      Node* prev = node->prev;
+      if (pred(node)) {
+        return node;
+      }
+      node = prev;
+    }
+    return nullptr;
+  }
+
+  /** \brief Method that finds element in the list by value.
+   * \param val value that will be found
+   * \param position if given, receives the position of the found node
+   *
+   * It searches the node with value val iterating the list forward.
+   *
+   * \return pointer to the found node.
+   *
+   * \note This method is guaranteed not to throw an exception.
+   */
+  Node* find(const T& val, size_t* position = nullptr) noexcept {
+    if (position) {
+      size_t before = 0;
+      Node* found = scan_forward(head, [&val, &before](Node* node) {
+        if (!is_alive(node)) {
+          return false;
+        }
+        if (node->value == val) {
+          return true;
+        }
+        ++before;
+        return false;
+      });
+      *position = before;
+      return found;
+    }
+    return scan_forward(head, [&val](Node* node) {
+      if constexpr (std::is_arithmetic<T>::value) {
+        // Both tests are cheap, so evaluate them together without a branch.
+        return is_alive(node) & (node->value == val);
+      } else {
+        return is_alive(node) && node->value == val;
+      }
+    });
   }
 };
\ No newline at end of file
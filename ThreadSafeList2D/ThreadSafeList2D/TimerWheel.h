@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "AdaptiveMutex.h"
+#include "NodePool.h"
+
+/**
+ * \class TimerWheel
+ *
+ *
+ * \brief Thread safe hashed timing wheel of items with deadlines.
+ *
+ * \tparam T Class of the items.
+ * \tparam Lock Lockable type guarding the wheel.
+ * \tparam Clock Clock the deadlines are measured with.
+ *
+ * Time is cut into ticks, and a deadline falls into slot (tick % kSlots).
+ * Every slot is a doubly linked list, so schedule() and cancel() are O(1).
+ * advance(now) visits only the slots of the ticks that passed since the
+ * previous call and returns the expired items in one batch; items due
+ * after more than one turn of the wheel stay in their slot until their
+ * deadline is reached. An item is never returned before its deadline and
+ * at most one tick after the advance() that could have returned it.
+ *
+ * Node storage comes from NodePool. Up to NodePool::kBatch nodes of fired
+ * or cancelled timers are kept on a free list of the wheel and reused, the
+ * rest go back to the pool, so a burst of timers does not pin its nodes.
+ * A stale Handle may therefore point to a node another wheel reuses: pool
+ * storage is never unmapped and timer ids are unique in the process, so
+ * cancel() still tells it apart by the id.
+ *
+ * Copy constructor and copy assignment operations are restricted (deleted).
+ *
+ *
+ * \author Liliya Makhmutova
+ *
+ * \version 1.0
+ *
+ * \date $Date: 2021/01/19 00:00:00 $
+ */
+template <class T, class Lock = AdaptiveMutex,
+          class Clock = std::chrono::steady_clock>
+class TimerWheel {
+  using TimePoint = typename Clock::time_point;
+  using Duration = typename Clock::duration;
+
+  /// Pending timer, or a free node if id is 0.
+  struct Node {
+    Node* next = nullptr;
+    Node* prev = nullptr;
+    TimePoint deadline;
+    std::atomic<uint64_t> id{0};  /// read by cancel() of stale handles
+    size_t slot = 0;  /// index into slots_ while pending
+    std::optional<T> item;
+  };
+
+  /// Doubly linked list of the timers of one slot.
+  struct Slot {
+    Node* head = nullptr;
+    Node* tail = nullptr;
+  };
+
+ public:
+  /// Number of slots, a power of 2.
+  static constexpr size_t kSlots = 512;
+
+  /**
+   * \class Handle
+   *
+   *
+   * \brief Identifies a scheduled timer for cancel().
+   *
+   * A handle stays safe to pass to cancel() of its wheel after the timer
+   * fired or was cancelled; cancel() then returns false.
+   *
+   *
+   * \author Liliya Makhmutova
+   *
+   * \version 1.0
+   *
+   * \date $Date: 2021/01/19 00:00:00 $
+   */
+  class Handle {
+   public:
+    /// Handle of no timer.
+    Handle() noexcept : node_(nullptr), id_(0) {}
+
+   private:
+    friend class TimerWheel;
+
+    Handle(Node* node, uint64_t id) noexcept : node_(node), id_(id) {}
+
+    Node* node_;
+    uint64_t id_;
+  };
+
+  /** \brief Creates an empty wheel.
+   * \param tick time covered by one slot
+   * \param start time the first tick begins at
+   */
+  explicit TimerWheel(Duration tick = std::chrono::milliseconds(1),
+                      TimePoint start = Clock::now())
+      : tick_(tick > Duration::zero() ? tick : Duration(1)),
+        origin_(start),
+        current_(0),
+        size_(0),
+        free_(nullptr),
+        free_count_(0) {}
+
+  /// Copy constructor is disabled
+  TimerWheel(const TimerWheel& rhs) = delete;
+  /// Copy assignment is disabled
+  TimerWheel& operator=(const TimerWheel& rhs) = delete;
+
+  /// Destroys pending items and gives all nodes back to the pool
+  ~TimerWheel() {
+    for (Slot& slot : slots_) {
+      while (slot.head) {
+        Node* next = slot.head->next;
+        destroy_node(slot.head);
+        slot.head = next;
+      }
+    }
+    while (free_) {
+      Node* next = free_->next;
+      destroy_node(free_);
+      free_ = next;
+    }
+  }
+
+  /** \brief Method adds an item that expires at deadline.
+   * \param item value returned by advance() once the deadline passed
+   * \param deadline expiry time; a past deadline fires on the next advance()
+   *
+   * \return Outputs the handle to cancel the timer with.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  Handle schedule(T item, TimePoint deadline) {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = free_;
+    if (node) {
+      node->item.emplace(std::move(item));
+      free_ = node->next;
+      --free_count_;
+    } else {
+      node = create_node();
+      try {
+        node->item.emplace(std::move(item));
+      } catch (...) {
+        destroy_node(node);
+        throw;
+      }
+    }
+    const uint64_t id = next_id().fetch_add(1, std::memory_order_relaxed);
+    node->deadline = deadline;
+    node->id.store(id, std::memory_order_relaxed);
+    node->slot = std::max(ticks(deadline), current_) & (kSlots - 1);
+    Slot& slot = slots_[node->slot];
+    node->next = nullptr;
+    node->prev = slot.tail;
+    (slot.tail ? slot.tail->next : slot.head) = node;
+    slot.tail = node;
+    ++size_;
+    return Handle(node, id);
+  }
+
+  /** \brief Method cancels a pending timer.
+   * \param handle value returned by schedule() of this wheel
+   *
+   * \return Outputs false if the timer already fired or was cancelled.
+   *
+   * \warning this function uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  bool cancel(const Handle& handle) noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    Node* node = handle.node_;
+    if (!node || node->id.load(std::memory_order_relaxed) != handle.id_) {
+      return false;
+    }
+    unlink(node);
+    release(node);
+    return true;
+  }
+
+  /** \brief Method removes and returns every item whose deadline passed.
+   * \param now current time; time never goes back, an earlier now than in
+   * the previous call returns nothing
+   *
+   * Visits the slots of the ticks since the previous call, but never more
+   * than kSlots of them. If the result cannot be allocated, no timer is
+   * removed.
+   *
+   * \return Outputs the expired items, grouped by tick.
+   *
+   * \warning this function uses mutex lock_guard.
+   */
+  std::vector<T> advance(TimePoint now = Clock::now()) {
+    std::vector<T> expired;
+    std::lock_guard<Lock> lock(mutex_);
+    uint64_t target = ticks(now);
+    if (target < current_) {
+      return expired;
+    }
+    uint64_t first = target - current_ >= kSlots ? target - kSlots + 1
+                                                  : current_;
+    size_t due = 0;
+    for (uint64_t tick = first; tick <= target && size_ > 0; ++tick) {
+      for (Node* node = slots_[tick & (kSlots - 1)].head; node;
+           node = node->next) {
+        due += node->deadline <= now ? 1 : 0;
+      }
+    }
+    expired.reserve(due);  // before any node is unlinked
+    for (uint64_t tick = first; tick <= target && expired.size() < due;
+         ++tick) {
+      Node* node = slots_[tick & (kSlots - 1)].head;
+      while (node) {
+        Node* next = node->next;
+        if (node->deadline <= now) {
+          expired.push_back(std::move(*node->item));
+          unlink(node);
+          release(node);
+        }
+        node = next;
+      }
+    }
+    current_ = target;  // its slot may still hold later deadlines
+    return expired;
+  }
+
+  /** \brief Method that returns the number of pending timers.
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  size_t size() noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    return size_;
+  }
+
+  /** \brief Method that returns true if no timer is pending.
+   *
+   * \warning this finction uses mutex lock_guard.
+   * \note This method is guaranteed not to throw an exception.
+   */
+  bool empty() noexcept {
+    std::lock_guard<Lock> lock(mutex_);
+    return size_ == 0;
+  }
+
+ private:
+  const Duration tick_;
+  const TimePoint origin_;
+  uint64_t current_;  /// tick of the last advance()
+  size_t size_;
+  Node* free_;         /// nodes of fired and cancelled timers
+  size_t free_count_;  /// length of free_, at most NodePool::kBatch
+  Slot slots_[kSlots];
+  mutable Lock mutex_;  /// to use std::lock_guard
+
+  /// Source of the ids of pending timers, shared by all wheels of this type
+  /// because their nodes are; 0 marks free nodes.
+  static std::atomic<uint64_t>& next_id() noexcept {
+    static std::atomic<uint64_t> id(1);
+    return id;
+  }
+
+  static Node* create_node() {
+    return new (NodePool<Node>::instance().allocate()) Node();
+  }
+
+  static void destroy_node(Node* node) noexcept {
+    node->~Node();
+    NodePool<Node>::instance().deallocate(node);
+  }
+
+  /// Number of whole ticks from the origin to time, 0 before the origin.
+  uint64_t ticks(TimePoint time) const noexcept {
+    return time > origin_ ? static_cast<uint64_t>((time - origin_) / tick_)
+                          : 0;
+  }
+
+  /// Detaches a pending node from its slot. Must be called under the lock.
+  void unlink(Node* node) noexcept {
+    Slot& slot = slots_[node->slot];
+    (node->prev ? node->prev->next : slot.head) = node->next;
+    (node->next ? node->next->prev : slot.tail) = node->prev;
+  }
+
+  /// Destroys the item of a detached node and puts it on the free list, or
+  /// back to the pool if the free list is full.
+  void release(Node* node) noexcept {
+    node->item.reset();
+    node->id.store(0, std::memory_order_relaxed);
+    --size_;
+    if (free_count_ >= NodePool<Node>::kBatch) {
+      destroy_node(node);
+      return;
+    }
+    node->next = free_;
+    node->prev = nullptr;
+    free_ = node;
+    ++free_count_;
+  }
+};
@@ -1,9 +1,28 @@
 #define TESTING_MODE  // comment it out in release
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#include "CohortLock.h"
+#include "NumaList2D.h"
+#include "PersistentList2D.h"
+#include "PriorityList2D.h"
 #include "ThreadSafeList2D.h"
+#include "TimerWheel.h"
 
 void FailWithMsg(const std::string& msg, int line) {
   std::cerr << "Test failed!\n";
@@ -28,6 +47,41 @@ void FailWithMsg(const std::string& msg, int line) {
 
 #define REPEAT(count) for (size_t _iter = 0; _iter < count; ++_iter)
 
+#ifndef _WIN32
+/// Returns true if fd is readable right now.
+bool IsReadable(int fd) {
+  pollfd entry = {fd, POLLIN, 0};
+  return poll(&entry, 1, 0) == 1 && (entry.revents & POLLIN);
+}
+#endif
+
+struct StringSerializer {
+  void write(const std::string& value, std::string& out) const {
+    out.append(value);
+  }
+  std::string read(const char* data, size_t size) const {
+    return std::string(data, size);
+  }
+};
+
+#ifdef THREAD_SAFE_LIST_COROUTINES
+/// Fire-and-forget coroutine used to drive async_pop_front().
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+DetachedTask PopInto(ThreadSafeList2D<int>& list, std::vector<int>& out,
+                     ThreadSafeList2D<int>::Executor executor = nullptr) {
+  out.push_back(co_await list.async_pop_front(std::move(executor)));
+}
+#endif
+
 int main() {
   {  // can create list, check emptiness, check exceptions
     ThreadSafeList2D<int> list;
@@ -193,6 +247,1531 @@ int main() {
     ASSERT_TRUE(list.size() == 0);
   }
   
+  {  // save and load snapshots, append to existing content, reject garbage
+    ThreadSafeList2D<int> list;
+    for (int i = 1; i <= 100000; ++i) {
+      list.push_back(i);
+    }
+    std::stringstream stream;
+    list.save(stream);
+
+    ThreadSafeList2D<int> restored;
+    restored.push_back(0);
+    restored.load(stream);
+    auto expected = list.get_fwd();
+    expected.insert(expected.begin(), 0);
+    ASSERT_TRUE(expected == restored.get_fwd());
+    std::reverse(expected.begin(), expected.end());
+    ASSERT_TRUE(expected == restored.get_bwd());
+    ASSERT_TRUE(restored.size() == 100001);
+
+    ThreadSafeList2D<std::string> strings;
+    strings.push_back("first");
+    strings.push_back("");
+    strings.push_back("third");
+    std::stringstream string_stream;
+    strings.save(string_stream, StringSerializer());
+    ThreadSafeList2D<std::string> strings_restored;
+    strings_restored.load(string_stream, StringSerializer());
+    ASSERT_TRUE(strings.get_fwd() == strings_restored.get_fwd());
+
+    std::string truncated = string_stream.str();
+    truncated.resize(truncated.size() - 2);
+    std::stringstream bad_stream(truncated);
+    try {
+      strings_restored.load(bad_stream, StringSerializer());
+      FailWithMsg("Expected SerializationError exception", __LINE__);
+    } catch (SerializationError const&) {
+    } catch (...) {
+      FailWithMsg("Expected SerializationError exception", __LINE__);
+    }
+    ASSERT_TRUE(strings_restored.size() == 3);
+  }
+
+  {  // forged element counts and lengths fail before allocating
+    auto expect_error = [](auto& list, auto&& load) {
+      try {
+        load(list);
+        FailWithMsg("Expected SerializationError exception", __LINE__);
+      } catch (SerializationError const&) {
+      } catch (...) {
+        FailWithMsg("Expected SerializationError exception", __LINE__);
+      }
+      ASSERT_TRUE(list.size() == 1);
+    };
+    auto header = [](uint32_t element_size, uint64_t count) {
+      std::string bytes("TSL2");
+      bytes.append(reinterpret_cast<const char*>(&element_size), 4);
+      bytes.append(reinterpret_cast<const char*>(&count), 8);
+      return bytes;
+    };
+    ThreadSafeList2D<int> ints;
+    ints.push_back(7);
+    std::string huge = header(sizeof(int), uint64_t(1) << 60) + "12345678";
+    expect_error(ints, [&huge](ThreadSafeList2D<int>& list) {
+      std::stringstream in(huge);
+      list.load(in);
+    });
+
+    ThreadSafeList2D<std::string> strings;
+    strings.push_back("kept");
+    uint32_t length = 0xFFFFFFF0;
+    std::string long_record =
+        header(0, 1) + std::string(reinterpret_cast<const char*>(&length), 4);
+    expect_error(strings, [&long_record](ThreadSafeList2D<std::string>& list) {
+      std::stringstream in(long_record);
+      list.load(in, StringSerializer());
+    });
+
+#ifndef _WIN32
+    // A pipe cannot tell how much is left: nodes come a slab at a time.
+    int fds[2];
+    ASSERT_TRUE(pipe(fds) == 0);
+    std::thread writer([&huge, fds] {
+      (void)!write(fds[1], huge.data(), huge.size());
+      close(fds[1]);
+    });
+    expect_error(ints, [fds](ThreadSafeList2D<int>& list) { list.load(fds[0]); });
+    writer.join();
+    close(fds[0]);
+#endif
+  }
+
+  {  // bulk-built slabs go back to the system with their last node
+    std::vector<int> values(100000, 1);
+    ThreadSafeList2D<int> list;
+    list.assign(values);
+    size_t reserved = ThreadSafeList2D<int>::pool_reserved();
+    REPEAT(50) { list.assign(values); }
+    ASSERT_TRUE(ThreadSafeList2D<int>::pool_reserved() <= reserved);
+    REPEAT(50) {  // nodes freed one by one release the slab as well
+      list.assign(values);
+      while (list.size() > 50000) {
+        list.pop_front();
+      }
+    }
+    ASSERT_TRUE(ThreadSafeList2D<int>::pool_reserved() <= 2 * reserved);
+    list.assign(values);
+    while (list.size() > 1) {  // a survivor pins only its own slab
+      list.pop_back();
+    }
+    ASSERT_TRUE(ThreadSafeList2D<int>::pool_reserved() <
+                reserved - values.size() / 2);
+  }
+
+  {  // persistent list survives reopening and recovers after a crash
+    const char* path = "persistent_list_test.bin";
+    std::remove(path);
+    {
+      PersistentList2D<int> list(path, 2);
+      for (int i = 1; i <= 5; ++i) {
+        list.push_back(i);
+      }
+      list.push_front(0);
+      list.remove(3);
+    }
+    {
+      PersistentList2D<int> list(path);
+      ASSERT_TRUE(std::vector<int>({0, 1, 2, 4, 5}) == list.get_fwd());
+      ASSERT_TRUE(std::vector<int>({5, 4, 2, 1, 0}) == list.get_bwd());
+      list.push_back(6);  // reuses the slot of the removed element
+      try {  // a second owner would recover the list under the first one
+        PersistentList2D<int> second(path);
+        FailWithMsg("Expected StorageError exception", __LINE__);
+      } catch (StorageError const&) {
+      }
+    }
+    {  // pretend the process died with stale tail and size
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      uint32_t dirty = 1;
+      uint64_t garbage = 12345;
+      file.seekp(12);
+      file.write(reinterpret_cast<const char*>(&dirty), sizeof(dirty));
+      file.seekp(40);
+      file.write(reinterpret_cast<const char*>(&garbage), sizeof(garbage));
+      file.write(reinterpret_cast<const char*>(&garbage), sizeof(garbage));
+    }
+    {
+      PersistentList2D<int> list(path);
+      ASSERT_TRUE(list.size() == 6);
+      ASSERT_TRUE(list.back() == 6);
+      ASSERT_TRUE(std::vector<int>({6, 5, 4, 2, 1, 0}) == list.get_bwd());
+    }
+    {  // more slots in use than the file holds
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      uint32_t dirty = 1;
+      uint64_t used = uint64_t(1) << 40;
+      file.seekp(12);
+      file.write(reinterpret_cast<const char*>(&dirty), sizeof(dirty));
+      file.seekp(24);
+      file.write(reinterpret_cast<const char*>(&used), sizeof(used));
+    }
+    try {
+      PersistentList2D<int> list(path);
+      FailWithMsg("Expected StorageError exception", __LINE__);
+    } catch (StorageError const&) {
+    }
+    std::remove(path);
+  }
+
+  {  // export streams a consistent copy without holding the lock
+    ThreadSafeList2D<int> list;
+    for (int i = 1; i <= 10; ++i) {
+      list.push_back(i);
+    }
+    std::vector<int> exported;
+    std::vector<size_t> chunk_sizes;
+    list.export_chunks(
+        [&](const int* values, size_t count) {
+          list.push_back(100);  // would deadlock if the lock was still held
+          exported.insert(exported.end(), values, values + count);
+          chunk_sizes.push_back(count);
+        },
+        3);
+    ASSERT_TRUE(std::vector<int>({1, 2, 3, 4, 5, 6, 7, 8, 9, 10}) == exported);
+    ASSERT_TRUE(std::vector<size_t>({3, 3, 3, 1}) == chunk_sizes);
+    ASSERT_TRUE(list.size() == 14);
+  }
+
+  {  // pop from both ends
+    ThreadSafeList2D<int> list;
+    list.push_back(1);
+    list.push_back(2);
+    list.push_back(3);
+    ASSERT_TRUE(list.pop_front() == 1);
+    ASSERT_TRUE(list.pop_back() == 3);
+    ASSERT_TRUE(list.pop_back() == 2);
+    ASSERT_TRUE(list.empty());
+    try {
+      list.pop_front();
+      FailWithMsg("Expected AcceessViolation exception", __LINE__);
+    } catch (AcceessViolation const&) {
+    } catch (...) {
+      FailWithMsg("Expected AcceessViolation exception", __LINE__);
+    }
+  }
+
+  {  // operation log keeps a replica in sync and reports lost records
+    ThreadSafeList2D<int> list;
+    ThreadSafeList2D<int> replica;
+    OpLog<int> log(64);
+    list.attach_log(&log);
+
+    list.push_back(1);
+    list.push_back(2);
+    list.push_front(0);
+    ASSERT_TRUE(replica.replay(log) == 3);
+    list.remove(1);
+    list.push_back(3);
+    list.pop_front();
+    list.pop_back();
+    ASSERT_TRUE(replica.replay(log) == 4);
+    ASSERT_TRUE(list.get_fwd() == replica.get_fwd());
+    ASSERT_TRUE(log.consumed_sequence() == 7);
+
+    OpLog<int> small_log(2);
+    list.attach_log(&small_log);
+    list.push_back(4);
+    list.push_back(5);
+    list.push_back(6);  // dropped, the ring is full
+    ThreadSafeList2D<int> other;
+    ASSERT_TRUE(other.replay(small_log) == 2);
+    list.push_back(7);
+    try {
+      other.replay(small_log);
+      FailWithMsg("Expected LogOverflow exception", __LINE__);
+    } catch (LogOverflow const&) {
+    } catch (...) {
+      FailWithMsg("Expected LogOverflow exception", __LINE__);
+    }
+    list.attach_log(nullptr);
+  }
+
+  {  // snapshots keep their version while the list changes
+    ThreadSafeList2D<int> list;
+    for (int i = 1; i <= 5; ++i) {
+      list.push_back(i);
+    }
+    {
+      auto view = list.snapshot();
+      list.remove(3);
+      list.pop_front();
+      list.push_back(6);
+      list.push_front(0);
+      ASSERT_TRUE(std::vector<int>({0, 2, 4, 5, 6}) == list.get_fwd());
+      ASSERT_TRUE(std::vector<int>({6, 5, 4, 2, 0}) == list.get_bwd());
+      ASSERT_TRUE(list.size() == 5);
+      ASSERT_TRUE(list.front() == 0);
+
+      auto later = list.snapshot();
+      list.pop_back();
+      list.remove(4);
+      ASSERT_TRUE(std::vector<int>({1, 2, 3, 4, 5}) == view.to_vector());
+      ASSERT_TRUE(view.size() == 5);
+      ASSERT_TRUE(std::vector<int>({0, 2, 4, 5, 6}) == later.to_vector());
+    }
+    ASSERT_TRUE(std::vector<int>({0, 2, 5}) == list.get_fwd());
+    ASSERT_TRUE(std::vector<int>({5, 2, 0}) == list.get_bwd());
+    try {
+      list.remove(4);  // removed while visible to a snapshot, gone now
+      FailWithMsg("Expected NotFound exception", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+  }
+
+  REPEAT(10) {  // snapshot readers run concurrently with writers
+    ThreadSafeList2D<int> list;
+    for (int i = 0; i < 1000; ++i) {
+      list.push_back(1);
+    }
+    std::thread writer([&list] {
+      for (int i = 0; i < 1000; ++i) {
+        list.pop_front();
+        list.push_back(1);
+      }
+    });
+    for (int i = 0; i < 50; ++i) {
+      auto view = list.snapshot();
+      size_t sum = 0;
+      view.for_each([&sum](const int& value) { sum += value; });
+      ASSERT_TRUE(sum == view.size());  // 999 between pop and push
+    }
+    writer.join();
+    ASSERT_TRUE(list.size() == 1000);
+  }
+
+  {  // transactions apply atomically and roll back on exceptions
+    ThreadSafeList2D<int> list;
+    for (int i = 1; i <= 4; ++i) {
+      list.push_back(i);
+    }
+    int rotated = list.transact([](auto& tx) {
+      int value = tx.pop_front();
+      tx.push_back(value);
+      return tx.front();
+    });
+    ASSERT_TRUE(rotated == 2);
+    ASSERT_TRUE(std::vector<int>({2, 3, 4, 1}) == list.get_fwd());
+
+    auto failing_transaction = [&list] {
+      try {
+        list.transact([](auto& tx) {
+          tx.remove(3);
+          tx.push_front(10);
+          tx.pop_back();
+          tx.remove(4);
+          tx.push_back(11);
+          ASSERT_TRUE(tx.size() == 3);
+          throw std::runtime_error("abort");
+        });
+        FailWithMsg("Expected exception", __LINE__);
+      } catch (std::runtime_error const&) {
+      }
+      ASSERT_TRUE(std::vector<int>({2, 3, 4, 1}) == list.get_fwd());
+      ASSERT_TRUE(std::vector<int>({1, 4, 3, 2}) == list.get_bwd());
+      ASSERT_TRUE(list.size() == 4);
+    };
+    failing_transaction();
+    auto view = list.snapshot();  // removed nodes are stamped, not unlinked
+    failing_transaction();
+  }
+
+  REPEAT(10) {  // other threads never see the intermediate state
+    ThreadSafeList2D<int> list;
+    for (int i = 0; i < 10; ++i) {
+      list.push_back(i);
+    }
+    std::thread rotator([&list] {
+      for (int i = 0; i < 1000; ++i) {
+        list.transact([](auto& tx) { tx.push_back(tx.pop_front()); });
+      }
+    });
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_TRUE(list.size() == 10);
+    }
+    rotator.join();
+  }
+
+  {  // move elements between lists
+    ThreadSafeList2D<int> first;
+    ThreadSafeList2D<int> second;
+    for (int i = 1; i <= 4; ++i) {
+      first.push_back(i);
+    }
+    first.move_front_to_back(second);
+    first.move_back_to_front(second);
+    first.move_front_to_front(second);
+    first.move_back_to_back(first);
+    ASSERT_TRUE(std::vector<int>({3}) == first.get_fwd());
+    ASSERT_TRUE(std::vector<int>({2, 4, 1}) == second.get_fwd());
+    ASSERT_TRUE(std::vector<int>({1, 4, 2}) == second.get_bwd());
+    {
+      auto view = second.snapshot();  // forces a copy instead of relinking
+      second.move_front_to_back(first);
+      ASSERT_TRUE(std::vector<int>({2, 4, 1}) == view.to_vector());
+    }
+    ASSERT_TRUE(std::vector<int>({3, 2}) == first.get_fwd());
+    ASSERT_TRUE(std::vector<int>({4, 1}) == second.get_fwd());
+    ASSERT_TRUE(first.size() == 2 && second.size() == 2);
+  }
+
+  REPEAT(10) {  // opposite moves between the same lists do not deadlock
+    ThreadSafeList2D<int> first;
+    ThreadSafeList2D<int> second;
+    for (int i = 0; i < 1000; ++i) {
+      first.push_back(i);
+      second.push_back(i);
+    }
+    std::thread forward([&] {
+      for (int i = 0; i < 1000; ++i) {
+        first.move_front_to_back(second);
+      }
+    });
+    std::thread backward([&] {
+      for (int i = 0; i < 1000; ++i) {
+        second.move_front_to_back(first);
+      }
+    });
+    forward.join();
+    backward.join();
+    ASSERT_TRUE(first.size() + second.size() == 2000);
+  }
+
+#ifdef THREAD_SAFE_LIST_COROUTINES
+  {  // coroutines wait for elements without blocking
+    ThreadSafeList2D<int> list;
+    std::vector<int> popped;
+    list.push_back(1);
+    PopInto(list, popped);  // completes immediately
+    ASSERT_TRUE(std::vector<int>({1}) == popped);
+
+    PopInto(list, popped);
+    PopInto(list, popped);
+    ASSERT_TRUE(popped.size() == 1);  // both are suspended
+    list.push_back(2);
+    list.push_front(3);  // waiters are served in arrival order
+    ASSERT_TRUE(std::vector<int>({1, 2, 3}) == popped);
+    ASSERT_TRUE(list.empty());
+
+    std::vector<std::coroutine_handle<>> queue;
+    auto executor = [&queue](std::coroutine_handle<> handle) {
+      queue.push_back(handle);
+    };
+    PopInto(list, popped, executor);
+    list.push_back(4);
+    ASSERT_TRUE(queue.size() == 1 && popped.size() == 3);
+    ASSERT_TRUE(list.empty());  // the element is already handed over
+    queue.back().resume();
+    ASSERT_TRUE(std::vector<int>({1, 2, 3, 4}) == popped);
+
+    PopInto(list, popped);  // expired elements are not handed over
+    list.set_ttl(std::chrono::nanoseconds(1));
+    list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+      tx.push_back(5);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    ASSERT_TRUE(popped.size() == 4 && list.empty());
+    list.set_ttl(std::chrono::steady_clock::duration::zero());
+    list.push_back(6);
+    ASSERT_TRUE(std::vector<int>({1, 2, 3, 4, 6}) == popped);
+  }
+
+  REPEAT(10) {  // pushes from many threads resume every waiter exactly once
+    ThreadSafeList2D<int> list;
+    std::vector<int> popped;
+    std::mutex popped_mutex;
+    auto serialized = [&popped_mutex](std::coroutine_handle<> handle) {
+      std::lock_guard<std::mutex> lock(popped_mutex);
+      handle.resume();  // runs on the pushing thread
+    };
+    for (int i = 0; i < 100; ++i) {
+      PopInto(list, popped, serialized);
+    }
+    std::vector<std::thread> pushers;
+    for (int t = 0; t < 4; ++t) {
+      pushers.emplace_back([&list, t] {
+        for (int i = 0; i < 25; ++i) {
+          list.push_back(t * 25 + i);
+        }
+      });
+    }
+    for (auto& pusher : pushers) {
+      pusher.join();
+    }
+    std::sort(popped.begin(), popped.end());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(popped[i] == i);
+    }
+    ASSERT_TRUE(list.empty());
+  }
+#endif
+
+#ifndef _WIN32
+  {  // notification descriptor signals empty -> non-empty and the watermark
+    ThreadSafeList2D<int> list;
+    int fd = list.notification_fd(3);
+    ASSERT_TRUE(fd >= 0 && fd == list.notification_fd(3));
+    ASSERT_TRUE(!IsReadable(fd));
+    list.push_back(1);
+    ASSERT_TRUE(IsReadable(fd));
+    list.push_back(2);  // signals coalesce
+    list.acknowledge_notification();
+    ASSERT_TRUE(!IsReadable(fd));
+    list.push_back(3);
+    ASSERT_TRUE(!IsReadable(fd));  // not empty before, not above watermark
+    list.push_front(0);
+    ASSERT_TRUE(IsReadable(fd));  // size went above 3
+    list.acknowledge_notification();
+    list.acknowledge_notification();  // nothing pending, does not block
+    while (!list.empty()) {
+      list.pop_front();
+    }
+    list.push_front(4);
+    ASSERT_TRUE(IsReadable(fd));
+    list.acknowledge_notification();
+
+    ThreadSafeList2D<int> other;
+    other.push_back(5);
+    other.move_front_to_back(list);
+    ASSERT_TRUE(!IsReadable(fd));
+    list.pop_front();
+    list.pop_front();
+    list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+      tx.push_back(6);
+    });
+    ASSERT_TRUE(IsReadable(fd));
+  }
+
+  {  // a consumer thread waits in poll() instead of spinning on empty()
+    ThreadSafeList2D<int> list;
+    int fd = list.notification_fd();
+    int sum = 0;
+    std::thread consumer([&] {
+      while (sum < 5050) {
+        pollfd entry = {fd, POLLIN, 0};
+        poll(&entry, 1, -1);
+        list.acknowledge_notification();
+        while (!list.empty()) {
+          sum += list.pop_front();
+        }
+      }
+    });
+    for (int i = 1; i <= 100; ++i) {
+      list.push_back(i);
+    }
+    consumer.join();
+    ASSERT_TRUE(sum == 5050);
+  }
+#endif
+
+  {  // adaptive lock counts contention, other locks can be plugged in
+    ThreadSafeList2D<int> list;
+    list.native_lock().set_spin_budget(0);  // park right away
+    ASSERT_TRUE(list.native_lock().spin_budget() == 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&list] {
+        for (int i = 0; i < 10000; ++i) {
+          list.push_back(i);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(list.size() == 40000);
+    LockStats stats = list.native_lock().stats();
+    ASSERT_TRUE(stats.acquisitions >= 40000);
+    ASSERT_TRUE(stats.parked <= stats.contended);
+    ASSERT_TRUE(stats.contention_rate() >= 0 && stats.contention_rate() <= 1);
+
+    ThreadSafeList2D<int, std::mutex> plain;
+    plain.push_back(1);
+    plain.push_front(0);
+    ASSERT_TRUE(std::vector<int>({0, 1}) == plain.get_fwd());
+  }
+
+  {  // NUMA mode keeps the list interface and steals from other nodes
+    ASSERT_TRUE(numa_node_count() >= 1);
+    ASSERT_TRUE(current_numa_node() < numa_node_count());
+
+    NumaList2D<int> list(2);
+    ASSERT_TRUE(list.node_count() == 2 && list.empty());
+    try {
+      list.pop_front();
+      FailWithMsg("Expected AcceessViolation exception", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+    size_t home = current_numa_node() % 2;
+    list.push_back(2);
+    list.push_front(1);
+    ASSERT_TRUE(list.sub_list(home).size() == 2);
+    list.sub_list(1 - home).push_back(3);  // as if pushed on the other node
+    ASSERT_TRUE(list.size() == 3);
+    ASSERT_TRUE(list.front() == 1 && list.back() == 2);
+    list.remove(3);
+    ASSERT_TRUE(list.sub_list(1 - home).empty());
+    try {
+      list.remove(3);
+      FailWithMsg("Expected ElementNotFound exception", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+    list.sub_list(1 - home).push_back(4);
+    ASSERT_TRUE(list.pop_front() == 1);
+    ASSERT_TRUE(list.pop_back() == 2);
+    ASSERT_TRUE(list.pop_front() == 4);  // stolen
+    ASSERT_TRUE(list.empty());
+
+    // sub-lists are used through their own operations, which honour TTLs
+    list.sub_list(1 - home).push_back_with_ttl(5, std::chrono::nanoseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    try {
+      list.pop_back();
+      FailWithMsg("Expected AcceessViolation exception", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+    ASSERT_TRUE(list.empty());
+    ASSERT_TRUE(!list.sub_list(home).pop_front_if_any());
+    list.sub_list(home).push_back(6);
+    ASSERT_TRUE(list.sub_list(home).front_if_any() == 6);
+    ASSERT_TRUE(list.sub_list(home).pop_back_if_any() == 6);
+    ASSERT_TRUE(!list.sub_list(home).remove_if_present(6));
+
+    // the element-wise rest of the interface is forwarded
+    int out = 0;
+    ASSERT_TRUE(list.try_pop_front(out) == ListStatus::Empty);
+    ASSERT_TRUE(list.try_push_back(7) == ListStatus::Ok);
+    ASSERT_TRUE(list.try_push_front_for(8, std::chrono::milliseconds(1)) ==
+                ListStatus::Ok);
+    list.sub_list(1 - home).push_back(9);
+    std::vector<int> forward = list.get_fwd();  // follows next links
+    std::vector<int> backward = list.get_bwd();  // follows prev links
+    ASSERT_TRUE(forward.size() == 3);
+    std::reverse(backward.begin(), backward.end());
+    ASSERT_TRUE(forward == backward);
+    ASSERT_TRUE(list.try_remove(9) == ListStatus::Ok);
+    ASSERT_TRUE(list.try_remove_for(9, std::chrono::milliseconds(1)) ==
+                ListStatus::NotFound);
+    ASSERT_TRUE(list.try_pop_back(out) == ListStatus::Ok && out == 7);
+    ASSERT_TRUE(list.try_pop_front_for(out, std::chrono::milliseconds(1)) ==
+                    ListStatus::Ok &&
+                out == 8);
+    list.set_ttl(std::chrono::hours(1));
+    list.push_back(10);
+    list.set_ttl(std::chrono::steady_clock::duration::zero());
+    list.push_front_with_ttl(11, std::chrono::hours(1));
+    list.sub_list(1 - home).push_back_with_ttl(12, std::chrono::hours(1));
+    auto later = std::chrono::steady_clock::now() + std::chrono::hours(2);
+    ASSERT_TRUE(list.expire(later) == 3 && list.empty());
+  }
+
+  {  // with several arenas, released slots go back to their owner
+    SimulatedNuma::node_count() = 2;  // also on single-node machines
+    SimulatedNuma::current_node() = 0;
+    {
+      NumaList2D<short> list;  // a new node type, its pool has two arenas
+      ASSERT_TRUE(list.node_count() == 2);
+      auto on_node = [](size_t node, auto&& fn) {
+        std::thread worker([node, &fn] {
+          SimulatedNuma::current_node() = node;
+          fn();
+        });
+        worker.join();
+      };
+      size_t reserved = 0;
+      for (int round = 0; round < 5; ++round) {
+        on_node(1, [&list] {
+          for (int i = 0; i < 1000; ++i) {
+            list.push_back(static_cast<short>(i));
+          }
+        });
+        for (int i = 0; i < 1000; ++i) {
+          list.push_back(static_cast<short>(-i));
+        }
+        ASSERT_TRUE(list.sub_list(0).size() == 1000 &&
+                    list.sub_list(1).size() == 1000);
+        on_node(1, [&list] {  // frees node 0's slots, steals the rest
+          for (int i = 0; i < 2000; ++i) {
+            list.pop_back();
+          }
+        });
+        ASSERT_TRUE(list.empty());
+        if (round == 0) {
+          reserved = ThreadSafeList2D<short>::pool_reserved();
+        }
+      }
+      // every round reuses the slots of the first one from the right arena
+      ASSERT_TRUE(ThreadSafeList2D<short>::pool_reserved() == reserved);
+    }
+    SimulatedNuma::current_node() = SIZE_MAX;
+    SimulatedNuma::node_count() = 0;
+  }
+
+  REPEAT(10) {  // concurrent NUMA pushes and pops lose nothing
+    NumaList2D<int> list;
+    std::vector<std::thread> threads;
+    std::atomic<long> sum(0);
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&list, &sum] {
+        for (int i = 1; i <= 1000; ++i) {
+          list.push_back(i);
+          sum += list.pop_front();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(sum == 4 * 500500 && list.empty());
+  }
+
+  REPEAT(10) {  // cohort lock keeps the list consistent under contention
+    ThreadSafeList2D<int, CohortLock> list;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&list] {
+        for (int i = 0; i < 1000; ++i) {
+          list.push_back(i);
+          list.pop_front();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(list.empty());
+
+    CohortLock lock(1);
+    ASSERT_TRUE(lock.try_lock());
+    ASSERT_TRUE(!lock.try_lock());
+    lock.unlock();
+    ASSERT_TRUE(lock.try_lock());
+    lock.unlock();
+  }
+
+  {  // producer handle publishes buffered pushes in batches
+    ThreadSafeList2D<int> list;
+    {
+      auto producer = list.make_producer(3, std::chrono::nanoseconds(0));
+      producer.push_back(1);
+      producer.push_back(2);
+      ASSERT_TRUE(list.empty() && producer.pending() == 2);
+      producer.push_back(3);  // size threshold
+      ASSERT_TRUE(std::vector<int>({1, 2, 3}) == list.get_fwd());
+      ASSERT_TRUE(producer.pending() == 0);
+      producer.push_back(4);
+      producer.flush();
+      ASSERT_TRUE(list.size() == 4);
+      producer.push_back(5);
+      auto moved = std::move(producer);
+      ASSERT_TRUE(producer.pending() == 0 && moved.pending() == 1);
+    }  // destruction publishes the rest
+    ASSERT_TRUE(std::vector<int>({1, 2, 3, 4, 5}) == list.get_fwd());
+    ASSERT_TRUE(std::vector<int>({5, 4, 3, 2, 1}) == list.get_bwd());
+
+    auto producer = list.make_producer(1000, std::chrono::nanoseconds(1));
+    producer.push_back(6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    producer.push_back(7);  // time threshold
+    ASSERT_TRUE(list.size() == 7 && list.back() == 7);
+  }
+
+  REPEAT(10) {  // concurrent producers lose nothing
+    ThreadSafeList2D<int> list;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&list] {
+        auto producer = list.make_producer(64);
+        for (int i = 1; i <= 1000; ++i) {
+          producer.push_back(i);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(list.size() == 4000);
+    long sum = 0;
+    while (!list.empty()) {
+      sum += list.pop_front();
+    }
+    ASSERT_TRUE(sum == 4 * 500500);
+  }
+
+  {  // trivially copyable values take the bitwise paths
+    struct Point {
+      int x;
+      int y;
+      bool operator==(const Point& rhs) const {
+        return x == rhs.x && y == rhs.y;
+      }
+    };
+    REPEAT(3) {  // destroyed lists give their chains back to the pool whole
+      ThreadSafeList2D<Point> list;
+      for (int i = 0; i < 1000; ++i) {
+        list.push_back({i, -i});
+      }
+      list.remove({500, -500});
+      auto view = list.snapshot();
+      list.pop_front();
+      std::vector<Point> points = view.to_vector();
+      ASSERT_TRUE(points.size() == 999 && points[0] == Point({0, 0}));
+      ASSERT_TRUE(points[500] == Point({501, -501}));
+      ASSERT_TRUE(list.get_fwd().size() == 998);
+      ASSERT_TRUE(list.get_bwd().front() == Point({999, -999}));
+      std::vector<Point> exported;
+      list.export_chunks(
+          [&exported](const Point* data, size_t count) {
+            exported.insert(exported.end(), data, data + count);
+          },
+          100);
+      ASSERT_TRUE(exported == list.get_fwd());
+    }
+    ThreadSafeList2D<double> reals;
+    reals.push_back(0.5);
+    reals.push_back(-0.0);
+    reals.remove(0.0);  // == semantics, not bitwise
+    ASSERT_TRUE(std::vector<double>({0.5}) == reals.get_fwd());
+  }
+
+  {  // lookup and removal by key without building a full element
+    struct Record {
+      int id;
+      std::string payload;
+      bool operator==(const Record& rhs) const {
+        return id == rhs.id && payload == rhs.payload;
+      }
+    };
+    auto id_of = [](const Record& record) -> const int& { return record.id; };
+    ThreadSafeList2D<Record> records;
+    for (int i = 0; i < 5; ++i) {
+      records.push_back({i, std::string(100, 'a' + i)});
+    }
+    ASSERT_TRUE(records.find_by(3, id_of).payload == std::string(100, 'd'));
+    records.remove_by_key(3, id_of);
+    ASSERT_TRUE(records.size() == 4);
+    try {
+      records.find_by(3, id_of);
+      FailWithMsg("Expected ElementNotFound exception", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+    try {
+      records.remove_by_key(3, id_of);
+      FailWithMsg("Expected ElementNotFound exception", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+
+    ThreadSafeList2D<std::string> names;
+    names.push_back("alpha");
+    names.push_back("beta");
+    ASSERT_TRUE(names.find_by("beta") == "beta");  // std::string == char*
+    names.remove_by_key("alpha");
+    ASSERT_TRUE(std::vector<std::string>({"beta"}) == names.get_fwd());
+
+    struct Versioned {  // == ignores the version the key is taken from
+      int id;
+      int version;
+      bool operator==(const Versioned& rhs) const { return id == rhs.id; }
+    };
+    auto version_of = [](const Versioned& value) { return value.version; };
+    ThreadSafeList2D<Versioned> primary;
+    ThreadSafeList2D<Versioned> replica;
+    OpLog<Versioned> log(16);
+    primary.attach_log(&log);
+    primary.push_back({1, 1});
+    primary.push_back({1, 2});
+    primary.push_back({1, 3});
+    primary.remove_by_key(2, version_of);
+    ASSERT_TRUE(replica.replay(log) == 4);
+    ASSERT_TRUE(replica.size() == 2 && replica.front().version == 1 &&
+                replica.back().version == 3);
+  }
+
+  {  // construction and assignment from iterators and ranges
+    std::vector<int> values = {1, 2, 3, 4};
+    ThreadSafeList2D<int> from_iterators(values.begin(), values.end());
+    ASSERT_TRUE(values == from_iterators.get_fwd());
+    ASSERT_TRUE(std::vector<int>({4, 3, 2, 1}) == from_iterators.get_bwd());
+    ThreadSafeList2D<int> from_range(values);
+    ASSERT_TRUE(from_range.size() == 4 && from_range.back() == 4);
+    ThreadSafeList2D<std::string> from_braces = {"a", "b"};
+    ASSERT_TRUE(from_braces.size() == 2 && from_braces.front() == "a");
+    ThreadSafeList2D<int> empty(values.end(), values.end());
+    ASSERT_TRUE(empty.empty());
+
+    std::istringstream input("5 6 7");  // single-pass iterators
+    ThreadSafeList2D<int> from_stream{std::istream_iterator<int>(input),
+                                      std::istream_iterator<int>()};
+    ASSERT_TRUE(std::vector<int>({5, 6, 7}) == from_stream.get_fwd());
+
+    from_stream.push_back(8);
+    from_stream.assign(values);
+    ASSERT_TRUE(values == from_stream.get_fwd());
+    {
+      auto view = from_stream.snapshot();  // old nodes are retired instead
+      from_stream.assign({9});
+      ASSERT_TRUE(values == view.to_vector());
+      ASSERT_TRUE(std::vector<int>({9}) == from_stream.get_fwd());
+    }
+    from_stream.assign(std::vector<int>());
+    ASSERT_TRUE(from_stream.empty() && from_stream.get_bwd().empty());
+
+    OpLog<std::string> log(16);
+    from_braces.attach_log(&log);
+    from_braces.assign({"c"});
+    ThreadSafeList2D<std::string> replica = {"a", "b"};
+    replica.replay(log);
+    ASSERT_TRUE(from_braces.get_fwd() == replica.get_fwd());
+  }
+
+  {  // compaction lays the nodes out in list order
+    ThreadSafeList2D<std::string> list;
+    for (int i = 0; i < 100; ++i) {
+      list.push_front(std::to_string(i));
+      list.push_back(std::to_string(i));
+    }
+    for (int i = 0; i < 100; i += 2) {
+      list.remove(std::to_string(i));
+    }
+    std::vector<std::string> before = list.get_fwd();
+    {
+      auto view = list.snapshot();
+      ASSERT_TRUE(!list.compact());  // readers may hold node pointers
+    }
+    ASSERT_TRUE(list.compact());
+    ASSERT_TRUE(list.is_contiguous());
+    ASSERT_TRUE(before == list.get_fwd());
+    std::reverse(before.begin(), before.end());
+    ASSERT_TRUE(before == list.get_bwd());
+    list.push_back("x");
+    list.pop_front();
+    list.remove("1");
+    ASSERT_TRUE(list.size() == 149 && list.back() == "x");
+
+    ThreadSafeList2D<int> counted;
+    counted.set_auto_compact(10);
+    for (int i = 0; i < 100; ++i) {
+      counted.push_front(i);
+      counted.push_back(i);
+    }
+    for (int i = 0; i < 9; ++i) {
+      counted.pop_back();
+    }
+    ASSERT_TRUE(!counted.is_contiguous());
+    counted.remove(50);  // tenth removal
+    ASSERT_TRUE(counted.is_contiguous() && counted.size() == 190);
+
+    // Every compaction takes a new slab, the one it replaces goes back.
+    ThreadSafeList2D<int> churned;
+    for (int i = 0; i < 10000; ++i) {
+      churned.push_back(i);
+    }
+    churned.set_auto_compact(100);
+    auto churn = [&churned] {
+      REPEAT(20000) {
+        churned.push_back(1);
+        churned.pop_front();
+      }
+    };
+    churn();
+    size_t reserved = ThreadSafeList2D<int>::pool_reserved();
+    REPEAT(10) { churn(); }
+    ASSERT_TRUE(ThreadSafeList2D<int>::pool_reserved() <= reserved + 10000);
+  }
+
+  {  // positional access through the block index
+    ThreadSafeList2D<int> list;
+    std::vector<int> model;
+    for (int i = 0; i < 3000; ++i) {
+      list.push_back(i);
+      model.push_back(i);
+    }
+    ASSERT_TRUE(list.at(0) == 0 && list.at(2999) == 2999);
+    std::mt19937 random(69);
+    for (int i = 0; i < 20000; ++i) {
+      size_t position = random() % (model.size() + 1);
+      switch (random() % 9) {
+        case 0:
+        case 1:
+          list.insert_at(position, -i);
+          model.insert(model.begin() + position, -i);
+          break;
+        case 2:
+          if (position < model.size()) {
+            ASSERT_TRUE(list.erase_at(position) == model[position]);
+            model.erase(model.begin() + position);
+          }
+          break;
+        case 3:
+          list.push_front(i);
+          model.insert(model.begin(), i);
+          list.pop_back();
+          model.pop_back();
+          break;
+        case 5:  // runs of pops empty and merge blocks
+          for (int k = 0; k < 600 && model.size() > 1; ++k) {
+            if (i % 2 == 0) {
+              ASSERT_TRUE(list.pop_front() == model.front());
+              model.erase(model.begin());
+            } else {
+              ASSERT_TRUE(list.pop_back() == model.back());
+              model.pop_back();
+            }
+          }
+          for (int k = 0; k < 500; ++k) {
+            list.push_front(k);
+            model.insert(model.begin(), k);
+          }
+          break;
+        case 4: {  // removals by value count the position on their walk
+          int value = model[position % model.size()];
+          if (i % 2) {
+            list.remove(value);
+          } else {
+            list.remove_by_key(value);
+          }
+          model.erase(std::find(model.begin(), model.end(), value));
+          break;
+        }
+        case 6: {  // transactions update the index, rollback restores it
+          int value = model[position % model.size()];
+          try {
+            list.transact([value, i](ThreadSafeList2D<int>::Transaction& tx) {
+              tx.remove(value);
+              tx.push_front(i);
+              tx.pop_back();
+              tx.push_back(-i);
+              if (i % 3 == 0) {
+                throw std::runtime_error("undo");
+              }
+            });
+            model.erase(std::find(model.begin(), model.end(), value));
+            model.insert(model.begin(), i);
+            model.pop_back();
+            model.push_back(-i);
+          } catch (std::runtime_error const&) {
+          }
+          break;
+        }
+        case 7:
+          if (i % 100 == 0) {
+            list.compact();  // rebuilds the index
+          }
+          break;
+        default:
+          if (position < model.size()) {
+            ASSERT_TRUE(list.at(position) == model[position]);
+          }
+      }
+    }
+    ASSERT_TRUE(model == list.get_fwd());
+    ASSERT_TRUE(list.is_indexed());
+
+    try {
+      list.at(model.size());
+      FailWithMsg("at() past the end", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+    try {
+      list.insert_at(model.size() + 1, 0);
+      FailWithMsg("insert_at() past the end", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+
+    ThreadSafeList2D<std::string> names = {"a", "c"};
+    OpLog<std::string> log(16);
+    names.attach_log(&log);
+    {
+      auto view = names.snapshot();  // erased nodes are only stamped
+      names.insert_at(1, "b");
+      ASSERT_TRUE(names.erase_at(0) == "a");
+      names.insert_at(2, "d");
+      ASSERT_TRUE(std::vector<std::string>({"a", "c"}) == view.to_vector());
+    }
+    ASSERT_TRUE(std::vector<std::string>({"b", "c", "d"}) == names.get_fwd());
+    ThreadSafeList2D<std::string> replica = {"a", "c"};
+    replica.replay(log);
+    ASSERT_TRUE(names.get_fwd() == replica.get_fwd());
+  }
+
+  {  // insert_at() waits for walks and checks the position again
+    ThreadSafeList2D<int> list = {0, 1, 2, 3};
+    list.at(0);
+    std::atomic<bool> walking(false);
+    std::atomic<bool> release(false);
+    std::thread walker([&] {
+      auto view = list.snapshot();
+      view.for_each([&](const int&) {
+        walking = true;
+        while (!release) {
+          std::this_thread::yield();
+        }
+      });
+    });
+    while (!walking) {
+      std::this_thread::yield();
+    }
+    std::atomic<bool> inserted(false);
+    std::thread inserter([&] {
+      list.insert_at(2, 99);
+      inserted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_TRUE(!inserted);
+    list.pop_back();
+    list.pop_back();  // position 2 is now the end
+    release = true;
+    walker.join();
+    inserter.join();
+    ASSERT_TRUE(std::vector<int>({0, 1, 99}) == list.get_fwd());
+
+    ThreadSafeList2D<int> big;
+    for (int i = 0; i < 100000; ++i) {
+      big.push_back(i);
+    }
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+      readers.emplace_back([&] {
+        while (!stop) {
+          long long sum = 0;
+          big.snapshot().for_each([&sum](const int& value) { sum += value; });
+        }
+      });
+    }
+    for (int i = 0; i < 20; ++i) {  // a stream of walks must not starve it
+      big.insert_at(50000, -i);
+    }
+    stop = true;
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+    ASSERT_TRUE(big.size() == 100020 && big.at(50000) == -19);
+  }
+
+  {  // priority buckets pop the highest level first, FIFO within a level
+    PriorityList2D<std::string> list;
+    ASSERT_TRUE(list.empty());
+    list.push("low", 0);
+    list.push("high-1", 63);
+    list.push("mid", 17);
+    list.push("high-2", 63);
+    ASSERT_TRUE(list.size() == 4 && list.size(63) == 2);
+    ASSERT_TRUE(list.highest_priority() == 63 && list.top() == "high-1");
+    ASSERT_TRUE(list.pop_highest() == "high-1");
+    list.remove("high-2");
+    ASSERT_TRUE(list.highest_priority() == 17);
+    ASSERT_TRUE(list.pop_highest() == "mid");
+    ASSERT_TRUE(list.pop_highest() == "low");
+    ASSERT_TRUE(list.empty());
+    try {
+      list.pop_highest();
+      FailWithMsg("pop_highest() of an empty list", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+    try {
+      list.push("x", PriorityList2D<std::string>::kLevels);
+      FailWithMsg("push() with a priority out of range", __LINE__);
+    } catch (AcceessViolation const&) {
+    }
+    try {
+      list.remove("x");
+      FailWithMsg("remove() of a missing element", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+
+    PriorityList2D<int> shared;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&shared, t] {
+        for (int i = 0; i < 1000; ++i) {
+          shared.push(i, (i + t) % 64);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(shared.size() == 4000);
+    size_t previous = 63;
+    while (!shared.empty()) {
+      size_t priority = shared.highest_priority();
+      ASSERT_TRUE(priority <= previous);
+      size_t value = static_cast<size_t>(shared.pop_highest());
+      ASSERT_TRUE((priority + 64 - value % 64) % 64 < 4);  // (i + t) % 64
+      previous = priority;
+    }
+  }
+
+  {  // timer wheel returns items once their deadline passed
+    using std::chrono::milliseconds;
+    auto origin = std::chrono::steady_clock::now();
+    TimerWheel<std::string> wheel(milliseconds(1), origin);
+    wheel.schedule("5ms", origin + milliseconds(5));
+    wheel.schedule("3ms", origin + milliseconds(3));
+    auto cancelled = wheel.schedule("4ms", origin + milliseconds(4));
+    wheel.schedule("700ms", origin + milliseconds(700));  // next turn
+    ASSERT_TRUE(wheel.size() == 4);
+    ASSERT_TRUE(wheel.cancel(cancelled) && !wheel.cancel(cancelled));
+    ASSERT_TRUE(!wheel.cancel(decltype(wheel)::Handle()));
+    ASSERT_TRUE(wheel.advance(origin + milliseconds(2)).empty());
+    ASSERT_TRUE(std::vector<std::string>({"3ms"}) ==
+                wheel.advance(origin + milliseconds(4)));
+    ASSERT_TRUE(std::vector<std::string>({"5ms"}) ==
+                wheel.advance(origin + milliseconds(10)));
+    auto late = wheel.schedule("late", origin);  // fires on next advance
+    ASSERT_TRUE(std::vector<std::string>({"late"}) ==
+                wheel.advance(origin + milliseconds(10)));
+    ASSERT_TRUE(!wheel.cancel(late));
+    ASSERT_TRUE(wheel.advance(origin + milliseconds(699)).empty());
+    ASSERT_TRUE(wheel.advance(origin + milliseconds(5)).empty());
+    ASSERT_TRUE(std::vector<std::string>({"700ms"}) ==
+                wheel.advance(origin + milliseconds(5000)));
+    ASSERT_TRUE(wheel.empty());
+
+    TimerWheel<int> shared(milliseconds(1), origin);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&shared, origin, t] {
+        for (int i = 0; i < 1000; ++i) {
+          auto handle = shared.schedule(i, origin + milliseconds(i));
+          if ((i + t) % 2 == 0) {
+            shared.cancel(handle);
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(shared.size() == 2000);
+    size_t fired = shared.advance(origin + milliseconds(499)).size();
+    fired += shared.advance(origin + milliseconds(999)).size();
+    ASSERT_TRUE(fired == 2000 && shared.empty());
+
+    // nodes beyond the free list go back to the pool and may be reused by
+    // another wheel, where a stale handle must not reach them
+    TimerWheel<int> first(milliseconds(1), origin);
+    TimerWheel<int> second(milliseconds(1), origin);
+    std::vector<TimerWheel<int>::Handle> handles;
+    for (int i = 0; i < 1000; ++i) {
+      handles.push_back(first.schedule(i, origin + milliseconds(i)));
+    }
+    for (auto& handle : handles) {
+      ASSERT_TRUE(first.cancel(handle));
+    }
+    second.schedule(-1, origin);  // takes the last node first gave back
+    for (auto& handle : handles) {
+      ASSERT_TRUE(!first.cancel(handle));
+    }
+    ASSERT_TRUE(first.empty() && second.size() == 1);
+    ASSERT_TRUE(std::vector<int>({-1}) == second.advance(origin));
+  }
+
+  {  // elements pushed with a TTL are dropped lazily or by expire()
+    using std::chrono::hours;
+    using std::chrono::milliseconds;
+    ThreadSafeList2D<int> list;
+    OpLog<int> log(64);
+    list.attach_log(&log);
+    list.set_ttl(milliseconds(10));
+    list.push_back(1);
+    list.push_back(2);
+    list.set_ttl(milliseconds(0));
+    list.push_back(3);  // never expires
+    list.push_back_with_ttl(4, hours(1));
+    auto now = std::chrono::steady_clock::now();
+    ASSERT_TRUE(list.expire(now) == 0 && list.size() == 4);
+    ASSERT_TRUE(list.expire(now + milliseconds(20)) == 2);
+    ASSERT_TRUE(std::vector<int>({3, 4}) == list.get_fwd());
+    ASSERT_TRUE(list.expire(now + hours(2)) == 0);  // 3 shields 4
+
+    list.push_front_with_ttl(0, std::chrono::nanoseconds(1));
+    list.push_back_with_ttl(5, std::chrono::nanoseconds(1));
+    std::this_thread::sleep_for(milliseconds(1));
+    ASSERT_TRUE(list.size() == 4);  // still counted until dropped
+    ASSERT_TRUE(list.front() == 3 && list.back() == 4);
+    ASSERT_TRUE(std::vector<int>({3, 4}) == list.get_fwd());
+    list.push_back_with_ttl(6, std::chrono::nanoseconds(1));
+    std::this_thread::sleep_for(milliseconds(1));
+    ASSERT_TRUE(list.pop_back() == 4);
+
+    ThreadSafeList2D<int> replica;
+    replica.replay(log);
+    ASSERT_TRUE(std::vector<int>({3}) == replica.get_fwd());
+  }
+
+  {  // transactions drop expired elements, rollback brings them back
+    using std::chrono::hours;
+    using std::chrono::milliseconds;
+    using std::chrono::nanoseconds;
+    ThreadSafeList2D<int> list;
+    list.push_back_with_ttl(1, nanoseconds(1));
+    list.push_back(2);
+    list.push_back_with_ttl(3, nanoseconds(1));
+    std::this_thread::sleep_for(milliseconds(1));
+    try {
+      list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+        ASSERT_TRUE(tx.front() == 2 && tx.back() == 2 && tx.size() == 1);
+        throw std::runtime_error("undo");
+      });
+      FailWithMsg("transaction did not throw", __LINE__);
+    } catch (std::runtime_error const&) {
+    }
+    ASSERT_TRUE(std::vector<int>({1, 2, 3}) == list.get_fwd());
+    ASSERT_TRUE(list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+      return tx.pop_front();
+    }) == 2);
+    ASSERT_TRUE(list.size() == 1 && list.expire() == 1);  // 3 kept its TTL
+
+    for (int i = 0; i < 100; ++i) {  // compaction moves the expiry times
+      list.push_back_with_ttl(i, i % 2 ? hours(1) : hours(3));
+    }
+    list.compact();
+    auto now = std::chrono::steady_clock::now();
+    ASSERT_TRUE(list.expire(now + hours(2)) == 0);
+    list.pop_front();
+    ASSERT_TRUE(list.expire(now + hours(2)) == 1 && list.size() == 98);
+
+    ThreadSafeList2D<int> reused;
+    reused.push_back_with_ttl(1, hours(1));
+    reused.pop_back();
+    reused.push_back(2);  // likely in the slot of 1, must not inherit its TTL
+    ASSERT_TRUE(reused.expire(now + hours(2)) == 0 && reused.size() == 1);
+  }
+
+  {  // set_ttl() covers every way of adding elements
+    using std::chrono::hours;
+    ThreadSafeList2D<int> list;
+    list.set_ttl(hours(1));
+    list.push_back(1);
+    list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+      tx.push_front(0);
+      tx.push_back(2);
+    });
+    {
+      auto producer = list.make_producer(16);
+      producer.push_back(3);
+    }
+    list.insert_at(2, 9);
+    list.assign(std::vector<int>(list.get_fwd()));
+    std::vector<int> more = {4, 5};
+    list.assign(more.begin(), more.end());
+    list.set_ttl(hours(0));
+    list.push_back(6);  // never expires
+    list.insert_at(0, 7);
+    auto later = std::chrono::steady_clock::now() + hours(2);
+    ASSERT_TRUE(list.size() == 4 && list.expire(later) == 0);  // 7 shields
+    list.pop_front();
+    ASSERT_TRUE(list.expire(later) == 2);
+    ASSERT_TRUE(std::vector<int>({6}) == list.get_fwd());
+
+    ThreadSafeList2D<int> source;
+    source.set_ttl(hours(1));
+    source.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+      tx.push_back(1);
+      tx.push_back(2);
+    });
+    {
+      auto producer = source.make_producer(16);
+      producer.push_back(3);
+    }
+    source.insert_at(1, 9);
+    ASSERT_TRUE(source.expire(later) == 4 && source.empty());
+
+    ThreadSafeList2D<int> expired;
+    ThreadSafeList2D<int> target;
+    expired.push_back_with_ttl(1, std::chrono::nanoseconds(1));
+    expired.push_back(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    expired.move_front_to_back(target);  // 1 expired, 2 is moved
+    ASSERT_TRUE(expired.empty() && std::vector<int>({2}) == target.get_fwd());
+  }
+
+  {  // several lists locked in address order act as one
+    std::mutex first;
+    std::mutex second;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {  // opposite argument orders
+      threads.emplace_back([&first, &second, t] {
+        for (int i = 0; i < 10000; ++i) {
+          std::mutex* a = t % 2 ? &first : &second;
+          std::mutex* b = t % 2 ? &second : &first;
+          MultiLock<std::mutex, 3> locks({a, b, a});
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(first.try_lock() && second.try_lock());
+    first.unlock();
+    second.unlock();
+
+    ThreadSafeList2D<int> a = {1, 2, 3};
+    ThreadSafeList2D<int> b;
+    ThreadSafeList2D<int> c = {9};
+    int moved = a.transact_with(
+        [](ThreadSafeList2D<int>::Transaction& from,
+           ThreadSafeList2D<int>::Transaction& to,
+           ThreadSafeList2D<int>::Transaction& extra) {
+          to.push_back(from.pop_front());
+          to.push_back(extra.pop_back());
+          return to.back();
+        },
+        b, c);
+    ASSERT_TRUE(moved == 9 && c.empty());
+    ASSERT_TRUE(std::vector<int>({1, 9}) == b.get_fwd());
+    try {
+      b.transact_with(
+          [](ThreadSafeList2D<int>::Transaction& from,
+             ThreadSafeList2D<int>::Transaction& to) {
+            to.push_front(from.pop_back());
+            throw ElementNotFound();
+          },
+          a);
+      FailWithMsg("transact_with() must rethrow", __LINE__);
+    } catch (ElementNotFound const&) {
+    }
+    ASSERT_TRUE(std::vector<int>({2, 3}) == a.get_fwd());  // rolled back
+    ASSERT_TRUE(std::vector<int>({1, 9}) == b.get_fwd());
+    try {  // one list must not get two transactions
+      a.transact_with([](ThreadSafeList2D<int>::Transaction&,
+                         ThreadSafeList2D<int>::Transaction&,
+                         ThreadSafeList2D<int>::Transaction&) {},
+                      b, a);
+      FailWithMsg("Expected std::invalid_argument exception", __LINE__);
+    } catch (std::invalid_argument const&) {
+    }
+    a.push_back(4);  // nothing was left locked
+    ASSERT_TRUE(std::vector<int>({2, 3, 4}) == a.get_fwd());
+    a.pop_back();
+
+    threads.clear();
+    for (int t = 0; t < 4; ++t) {  // rotate elements both ways
+      threads.emplace_back([&a, &b, t] {
+        ThreadSafeList2D<int>& from = t % 2 ? a : b;
+        ThreadSafeList2D<int>& to = t % 2 ? b : a;
+        for (int i = 0; i < 1000; ++i) {
+          from.transact_with(
+              [](ThreadSafeList2D<int>::Transaction& src,
+                 ThreadSafeList2D<int>::Transaction& dst) {
+                if (!src.empty()) {
+                  dst.push_back(src.pop_front());
+                }
+              },
+              to);
+          try {
+            from.move_back_to_front(to);
+            to.move_front_to_back(from);
+          } catch (AcceessViolation const&) {  // the other side was empty
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    ASSERT_TRUE(a.size() + b.size() == 4);
+  }
+
+  {  // try_ and _for operations report instead of waiting
+    using std::chrono::milliseconds;
+    ThreadSafeList2D<int> list;
+    int value = 0;
+    ASSERT_TRUE(list.try_push_back(1) == ListStatus::Ok);
+    ASSERT_TRUE(list.try_push_front_for(0, milliseconds(1)) == ListStatus::Ok);
+    ASSERT_TRUE(list.try_remove(5) == ListStatus::NotFound);
+    {
+      std::lock_guard<AdaptiveMutex> busy(list.native_lock());
+      std::thread([&list, &value] {
+        ASSERT_TRUE(list.try_push_back(2) == ListStatus::Busy);
+        ASSERT_TRUE(list.try_remove(1) == ListStatus::Busy);
+        ASSERT_TRUE(list.try_pop_front(value) == ListStatus::Busy);
+        ASSERT_TRUE(list.try_push_back_for(2, milliseconds(2)) ==
+                    ListStatus::Timeout);
+        ASSERT_TRUE(list.try_pop_back_for(value, milliseconds(0)) ==
+                    ListStatus::Timeout);
+      }).join();
+    }
+    ASSERT_TRUE(std::vector<int>({0, 1}) == list.get_fwd());
+    ASSERT_TRUE(list.try_pop_back(value) == ListStatus::Ok && value == 1);
+    ASSERT_TRUE(list.try_remove_for(0, milliseconds(1)) == ListStatus::Ok);
+    ASSERT_TRUE(list.try_pop_front_for(value, milliseconds(1)) ==
+                ListStatus::Empty);
+
+    struct TimedLock : AdaptiveMutex {  // preferred over polling try_lock()
+      std::atomic<int> timed_calls{0};
+      bool try_lock_until(std::chrono::steady_clock::time_point deadline) {
+        ++timed_calls;
+        while (!try_lock()) {
+          if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+          }
+          std::this_thread::yield();
+        }
+        return true;
+      }
+    };
+    ThreadSafeList2D<std::string, TimedLock> timed;
+    std::string text;
+    {
+      std::lock_guard<TimedLock> busy(timed.native_lock());
+      std::thread([&timed] {
+        ASSERT_TRUE(timed.try_push_front_for("a", milliseconds(2)) ==
+                    ListStatus::Timeout);
+      }).join();
+    }
+    ASSERT_TRUE(timed.try_push_front_for("a", milliseconds(2)) ==
+                ListStatus::Ok);
+    ASSERT_TRUE(timed.native_lock().timed_calls == 2);
+    ASSERT_TRUE(timed.try_pop_front(text) == ListStatus::Ok && text == "a");
+  }
+
+  {  // size() is wait-free and hides intermediate transaction sizes
+    using List = ThreadSafeList2D<int>;
+    List list = {1, 2, 3};
+    std::atomic<bool> done(false);
+    std::thread reader([&list, &done] {
+      while (!done) {
+        size_t size = list.size();
+        ASSERT_TRUE(size == 3 || size == 4);
+        ASSERT_TRUE(!list.empty());
+      }
+    });
+    for (int i = 0; i < 2000; ++i) {
+      list.transact([](List::Transaction& tx) {
+        for (int j = 0; j < 10; ++j) {
+          tx.push_back(j);
+        }
+        for (int j = 0; j < 10; ++j) {
+          tx.pop_back();
+        }
+      });
+      list.assign({1, 2, 3, 4});
+      list.pop_back();
+    }
+    {
+      std::lock_guard<AdaptiveMutex> busy(list.native_lock());
+      ASSERT_TRUE(list.size() == 3);  // needs no lock
+    }
+    done = true;
+    reader.join();
+
+    List counted;
+    ASSERT_TRUE(counted.size_relaxed() == 0);
+    counted.push_back(0);
+    ASSERT_TRUE(counted.size_relaxed() == 1);  // exact around empty
+    for (int i = 1; i < 1000; ++i) {
+      counted.push_back(i);
+      ASSERT_TRUE(counted.size() - counted.size_relaxed() < List::kSizeSlack);
+    }
+    while (!counted.empty()) {
+      counted.pop_front();
+    }
+    ASSERT_TRUE(counted.size_relaxed() == 0);
+  }
+
   { // time measuring tests
     time_t timer;
 
@@ -240,6 +1819,289 @@ int main() {
     std::cout << "Elapsed time for multithreaded version: "
               << (double)(clock() - timer) / CLOCKS_PER_SEC << " seconds"
               << std::endl;    
+
+    // With several NUMA nodes the threads are spread evenly over them, so
+    // the lock and the tail node travel between sockets.
+    const bool spread = numa_node_count() > 1;
+    auto contended_pushes = [spread](auto& list) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&list, spread, t] {
+          if (spread) {
+            bind_to_numa_node(t % numa_node_count());
+          }
+          for (int i = 0; i < 250000; ++i) {
+            list.push_back(i);
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      // pushes per second
+      return 1e6 / std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    };
+    {  // contended push_back with std::mutex, AdaptiveMutex and CohortLock
+      std::cout << "Contended push_back throughput, 4 threads "
+                << (spread ? "spread over " : "on ") << numa_node_count()
+                << " NUMA node(s):" << std::endl;
+      ThreadSafeList2D<int, std::mutex> locked;
+      ThreadSafeList2D<int> adaptive;
+      ThreadSafeList2D<int, CohortLock> cohort;
+      double baseline = contended_pushes(locked);
+      std::cout << "  std::mutex: " << baseline / 1e6 << " M pushes/s"
+                << std::endl;
+      double rate = contended_pushes(adaptive);
+      std::cout << "  AdaptiveMutex: " << rate / 1e6 << " M pushes/s ("
+                << rate / baseline << "x std::mutex, contention rate "
+                << adaptive.native_lock().stats().contention_rate() << ")"
+                << std::endl;
+      rate = contended_pushes(cohort);
+      std::cout << "  CohortLock: " << rate / 1e6 << " M pushes/s ("
+                << rate / baseline << "x std::mutex)" << std::endl;
+    }
+
+    {  // the same pushes through per-thread producer handles
+      ThreadSafeList2D<int> list;
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&list] {
+          auto producer = list.make_producer();
+          for (int i = 0; i < 250000; ++i) {
+            producer.push_back(i);
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      std::cout << "Elapsed time for 1M contended pushes with producers: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+    }
+
+    {  // highest-priority pops: one list per level versus PriorityList2D
+      std::mt19937 random(70);
+      std::vector<std::unique_ptr<ThreadSafeList2D<int>>> levels;
+      for (size_t i = 0; i < PriorityList2D<int>::kLevels; ++i) {
+        levels.emplace_back(new ThreadSafeList2D<int>());
+      }
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < 1000000; ++i) {
+        levels[random() % levels.size()]->push_back(i);
+        for (size_t level = levels.size(); level-- > 0;) {
+          if (!levels[level]->empty()) {
+            levels[level]->pop_front();
+            break;
+          }
+        }
+      }
+      std::cout << "Elapsed time for 1M push/pop pairs over 64 lists: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+
+      PriorityList2D<int> list;
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < 1000000; ++i) {
+        list.push(i, random() % PriorityList2D<int>::kLevels);
+        list.pop_highest();
+      }
+      std::cout << "Elapsed time for 1M push/pop_highest pairs: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+    }
+
+    {  // request timeouts: scanning a list versus the timer wheel
+      using std::chrono::milliseconds;
+      auto origin = std::chrono::steady_clock::now();
+      std::mt19937 random(71);
+      ThreadSafeList2D<int> pending;
+      auto start = std::chrono::steady_clock::now();
+      for (int ms = 0; ms < 1000; ++ms) {  // 100 requests a tick, 10K live
+        for (int i = 0; i < 100; ++i) {
+          pending.push_back(ms + 100 + static_cast<int>(random() % 100));
+        }
+        while (!pending.empty() && pending.front() <= ms) {
+          pending.pop_front();  // FIFO deadlines only, unlike the wheel
+        }
+        pending.remove_by_key(ms + 150);  // a completed request
+      }
+      std::cout << "Elapsed time for 100K timeouts kept in a list: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+
+      TimerWheel<int> wheel(milliseconds(1), origin);
+      start = std::chrono::steady_clock::now();
+      for (int ms = 0; ms < 1000; ++ms) {
+        TimerWheel<int>::Handle handle;
+        for (int i = 0; i < 100; ++i) {
+          handle = wheel.schedule(
+              i, origin + milliseconds(ms + 100 + random() % 100));
+        }
+        wheel.advance(origin + milliseconds(ms));
+        wheel.cancel(handle);
+      }
+      std::cout << "Elapsed time for 100K timeouts in a TimerWheel: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+    }
+
+    {  // pushes next to long remove() scans: waiting versus skipping
+      ThreadSafeList2D<int> list;
+      for (int i = 0; i < 2000000; ++i) {
+        list.push_back(i);
+      }
+      for (bool skip : {false, true}) {
+        std::atomic<bool> scanning(true);
+        std::thread scanner([&list, &scanning, skip] {
+          for (int i = 0; i < 20; ++i) {
+            list.remove_by_key(1999999 - i - 20 * skip);  // scans everything
+          }
+          scanning = false;
+        });
+        double longest = 0;
+        size_t skipped = 0;
+        size_t pushes = 0;
+        while (scanning) {
+          auto start = std::chrono::steady_clock::now();
+          if (skip) {
+            skipped += list.try_push_front(-1) != ListStatus::Ok;
+          } else {
+            list.push_front(-1);
+          }
+          ++pushes;
+          longest = std::max(longest, std::chrono::duration<double>(
+                                          std::chrono::steady_clock::now() -
+                                          start)
+                                          .count());
+        }
+        scanner.join();
+        std::cout << "Longest " << (skip ? "try_push_front" : "push_front")
+                  << " next to remove() scans: " << longest << " seconds ("
+                  << skipped << " of " << pushes << " skipped)" << std::endl;
+      }
+    }
+
+    {  // one large transaction: undo entries grow geometrically
+      ThreadSafeList2D<int> list;
+      auto start = std::chrono::steady_clock::now();
+      list.transact([](ThreadSafeList2D<int>::Transaction& tx) {
+        for (int i = 0; i < 1000000; ++i) {
+          tx.push_back(i);
+        }
+      });
+      ASSERT_TRUE(list.size() == 1000000);
+      std::cout << "Elapsed time for 1M pushes in one transaction: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << " seconds" << std::endl;
+    }
+
+    {  // load balancer polling sizes while a writer pushes
+      for (bool relaxed : {false, true}) {
+        ThreadSafeList2D<int> list;
+        std::thread writer([&list] {
+          for (int i = 0; i < 1000000; ++i) {
+            list.push_back(i);
+          }
+        });
+        auto start = std::chrono::steady_clock::now();
+        size_t sum = 0;
+        for (int i = 0; i < 10000000; ++i) {
+          sum += relaxed ? list.size_relaxed() : list.size();
+        }
+        std::cout << "Elapsed time for 10M "
+                  << (relaxed ? "size_relaxed" : "size")
+                  << "() calls next to a writer: "
+                  << std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+                  << " seconds" << std::endl;
+        writer.join();
+        ASSERT_TRUE(sum / 10000000 <= list.size());  // average of the reads
+      }
+    }
+
+    {  // full scans of a 10M-node list scattered over DRAM
+      // (build with THREAD_SAFE_LIST_NO_PREFETCH to compare)
+      auto seconds_since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+            .count();
+      };
+      std::vector<std::unique_ptr<ThreadSafeList2D<int>>> parts;
+      for (int i = 0; i < 1024; ++i) {
+        parts.emplace_back(new ThreadSafeList2D<int>());
+      }
+      std::mt19937 random(42);
+      for (int i = 0; i < 10000000; ++i) {
+        parts[random() % parts.size()]->push_back(i);
+      }
+      ThreadSafeList2D<int> list;  // neighbours are ~40KB apart in memory
+      for (auto& part : parts) {
+        while (!part->empty()) {
+          part->move_front_to_back(list);
+        }
+      }
+
+      for (const char* pass : {"first", "second"}) {  // jumps set by linking
+        auto start = std::chrono::steady_clock::now();
+        try {
+          list.remove(-1);  // scans every node
+        } catch (ElementNotFound const&) {
+        }
+        std::cout << "Elapsed time for a scattered 10M-node find(), " << pass
+                  << " pass: " << seconds_since(start) << " seconds"
+                  << std::endl;
+      }
+      auto start = std::chrono::steady_clock::now();
+      ASSERT_TRUE(list.get_bwd().size() == 10000000);
+      std::cout << "Elapsed time for a scattered 10M-node get_bwd(): "
+                << seconds_since(start) << " seconds" << std::endl;
+      list.compact();
+      start = std::chrono::steady_clock::now();
+      try {
+        list.remove(-1);
+      } catch (ElementNotFound const&) {
+      }
+      std::cout << "Elapsed time for a compacted 10M-node find(): "
+                << seconds_since(start) << " seconds" << std::endl;
+
+      list.at(0);  // builds the position index
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < 1000; ++i) {
+        size_t position = random() % list.size();
+        list.insert_at(position, list.at(position));
+        list.erase_at(position);
+      }
+      std::cout << "Elapsed time for 1K at/insert_at/erase_at triples on a "
+                   "10M-node list: "
+                << seconds_since(start) << " seconds" << std::endl;
+
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < 1000000; ++i) {  // the index is kept up to date
+        list.push_front(i);
+        list.pop_front();
+      }
+      std::cout << "Elapsed time for 1M push_front/pop_front pairs on an "
+                   "indexed 10M-node list: "
+                << seconds_since(start) << " seconds" << std::endl;
+    }
   }
 
   return 0;